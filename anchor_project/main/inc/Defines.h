@@ -177,6 +177,39 @@ uint16_t getAntennaDelayForAnchor(int anchorNumber) {
     }
 }
 
+// ============================================================================
+// ANTENNA DELAY AUTO-CALIBRATION
+// ============================================================================
+// Valor calibrado fica na NVS e tem prioridade sobre a tabela acima.
+// Modo calibração (comando MQTT {"calibrar": true}): a âncora reinicia como iniciador (TAG),
+// mede contra todas as outras âncoras do site por CALIBRATION_DURATION_MS, publica os ranges
+// (com id_tag = esta âncora) e reinicia como âncora. O host resolve os delays a partir dos pares
+// (data_analysis/data_collection/src/calibrate.py) e grava cada um com {"antenna_delay": N}.
+constexpr uint16_t SITE_ANCHOR_ADDRESSES[] = {0x2540, 0x3734, 0x2950, 0x3014, 0x8CD4, 0x7DB4,
+                                              0x31B8, 0x31C8, 0x325C, 0x3674, 0x2904, 0x297C};
+#define CALIBRATION_DURATION_MS 30000 // Tempo como iniciador por âncora
+
+// ============================================================================
+// TEMPERATURE DRIFT COMPENSATION
+// ============================================================================
+// Temperatura/tensão do DW1000 amostradas entre as trocas e publicadas com os ranges.
+// Delay efetivo = delay calibrado + DRIFT_TICKS_PER_DEGREE * (temperatura - temperatura da calibração);
+// a temperatura da calibração é salva na NVS junto com o delay ({"antenna_delay": N}).
+#define DRIFT_SAMPLE_PERIOD_MS 5000
+#define DRIFT_TICKS_PER_DEGREE 0.0f   // Ajustar por medida (1 tick ~ 4.7 mm no range); 0 = só mede
+#define DRIFT_REFERENCE_TEMP_C 25.0f  // Sem temperatura de calibração na NVS (ex.: delays da tabela)
+
+// ============================================================================
+// TDOA (BLINKS)
+// ============================================================================
+// Com TDOA_ENABLE a âncora não faz TWR: carimba cada BLINK da tag no relógio da âncora de referência
+// e publica (tag, seq, timestamp) no tópico uwb/ancoraN/tdoa; o host resolve pelas diferenças.
+// A tag precisa do mesmo TDOA_ENABLE. Sem efeito no modo calibração.
+#define TDOA_ENABLE false
+#define TDOA_REFERENCE_ANCHOR 1   // ANCHOR_NUMBER da âncora que envia os SYNC
+#define TDOA_SYNC_PERIOD_MS 200   // Período dos SYNC da referência
+#define TDOA_QUEUE_LENGTH 8       // BLINKs aguardando publicação (excedentes são descartados)
+
 //=============================================================================
 // lIMITS FOR DISTANCE CALCULATION
 // ============================================================================
@@ -191,3 +224,8 @@ uint16_t getAntennaDelayForAnchor(int anchorNumber) {
 #define NVS_WIFI_PASS "pass"
 #define NVS_READ_WRITE false
 
+#define NVS_CAL_NAMESPACE "uwb_cal"
+#define NVS_CAL_ANTENNA_DELAY "antenna_delay"
+#define NVS_CAL_MODE "calibrar"
+#define NVS_CAL_TEMPERATURE "cal_temp"
+
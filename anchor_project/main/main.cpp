@@ -36,6 +36,8 @@ namespace network_ctx
 namespace mqtt_ctx{
     // Buffer para tópico de configuração
     char mqtt_config_topic[64];
+    // Buffer para tópico dos BLINKs (TDOA)
+    char mqtt_tdoa_topic[64];
 
     // Handle cliente MQTT nativo
     esp_mqtt_client_handle_t handle_mqtt_client = NULL;
@@ -47,10 +49,24 @@ namespace mqtt_ctx{
     bool b_mqtt_initialized = false;
 }
 
+namespace calibration_ctx
+{
+    // Âncora iniciando ranges contra as outras (boot em modo calibração)
+    bool b_calibration_mode = false;
+    uint16_t antenna_delay = 0;
+    // Temperatura do DW1000 quando o delay foi calibrado (referência da compensação)
+    float reference_temp = DRIFT_REFERENCE_TEMP_C;
+
+    // Novo delay recebido por MQTT, aplicado pela task UWB (dona do SPI); 0 = nenhum
+    volatile uint16_t pending_antenna_delay = 0;
+    volatile bool b_restart_requested = false;
+}
+
 namespace rtos_ctx
 {
     // Handles FreeRTOS
     QueueHandle_t uwbQueue;
+    QueueHandle_t tdoaQueue;
     TaskHandle_t handle_task_dw1000;
     TaskHandle_t handle_task_network;
 }
@@ -70,6 +86,11 @@ typedef struct
     float fp_power;
     float eta;
     float quality;
+    uint16_t antenna_delay; // delay de antena efetivo da âncora que publica (id_tag se "cal", senão id_ancora)
+    float temperature;      // DW1000 da âncora que publica (°C)
+    float voltage;          // alimentação do DW1000 (V)
+    int64_t timestamp_us; // base de tempo estendida do DW1000 (DW1000Timebase), monotônica
+    int64_t imu_timestamp_us; // amostra ax/ay/az na mesma base, 0 se a tag não informou a idade
 } range_pkg;
 
 // ============================================================================
@@ -79,15 +100,19 @@ void task_dw1000_routine(void *parameter);
 void task_network_routine(void *parameter);
 
 void new_range_callback(DW1000Device *device);
+void tdoa_sample_callback(const TdoaSample &sample);
 void new_device_callback(DW1000Device *device);
 void inactive_device_callback(DW1000Device *device);
 
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data);
 
 void start_mqtt();
+void load_calibration();
+void manage_calibration();
 void manage_wifi_connection();
 void manage_mqtt_connection();
 void retrive_and_publish_range();
+void retrive_and_publish_tdoa();
 
 
 // ============================================================================
@@ -106,16 +131,52 @@ void setup()
     {
         Serial.println("Erro: Falha ao criar fila");
     }
+    // Vários BLINKs podem chegar entre dois publish, nenhum pode ser sobrescrito
+    rtos_ctx::tdoaQueue = xQueueCreate(TDOA_QUEUE_LENGTH, sizeof(TdoaSample));
+    if (rtos_ctx::tdoaQueue == NULL)
+    {
+        Serial.println("Erro: Falha ao criar fila TDOA");
+    }
 
     // --- PREENCHIMENTO DOS BUFFERS ---
     snprintf(mqtt_ctx::mqtt_client_id, sizeof(mqtt_ctx::mqtt_client_id), "ESP32_Anchor_%X", DW1000_ANCHOR_SHORT_ADDRESS);
     snprintf(mqtt_ctx::mqtt_config_topic, sizeof(mqtt_ctx::mqtt_config_topic), "uwb/ancora%d/config", ANCHOR_NUMBER);
+    snprintf(mqtt_ctx::mqtt_tdoa_topic, sizeof(mqtt_ctx::mqtt_tdoa_topic), "uwb/ancora%d/tdoa", ANCHOR_NUMBER);
+
+    load_calibration();
 
     // --- INICIALIZAÇÃO DO DW1000 ---
     SPI.begin(SPI_SCK, SPI_MISO, SPI_MOSI);
 
+    BoardType board_type = BoardType::DW1000_BOARD_TYPE;
+    if (calibration_ctx::b_calibration_mode)
+    {
+        // Iniciador contra todas as outras âncoras do site
+        uint16_t others[MAX_DEVICES];
+        uint8_t others_count = 0;
+        for (uint16_t address : SITE_ANCHOR_ADDRESSES)
+        {
+            if (address != DW1000_ANCHOR_SHORT_ADDRESS && others_count < MAX_DEVICES)
+            {
+                others[others_count++] = address;
+            }
+        }
+        if (others_count == 0)
+        {
+            // Nenhuma outra âncora no site: não há com quem medir
+            calibration_ctx::b_calibration_mode = false;
+            Serial.println("[CAL] Nenhuma outra âncora em SITE_ANCHOR_ADDRESSES, modo calibração ignorado");
+        }
+        else
+        {
+            DW1000Ranging.useMaestroAnchors(others, others_count);
+            board_type = BoardType::TAG;
+            Serial.printf("[CAL] Modo calibração: medindo contra %d âncoras\n", others_count);
+        }
+    }
+
     // Inicialização conforme Defines.h
-    DW1000Ranging.init(BoardType::DW1000_BOARD_TYPE,
+    DW1000Ranging.init(board_type,
                        DW1000_ANCHOR_SHORT_ADDRESS,
                        DW1000_ANCHOR_MAC_ADDRESS,
                        true,
@@ -127,11 +188,24 @@ void setup()
     DW1000Ranging.attachNewRange(new_range_callback);
     DW1000Ranging.attachNewDevice(new_device_callback);
     DW1000Ranging.attachInactiveDevice(inactive_device_callback);
+    DW1000Ranging.attachTdoaSample(tdoa_sample_callback);
 
-    uint16_t delayAntenna = getAntennaDelayForAnchor(ANCHOR_NUMBER);
-    DW1000.setAntennaDelay(delayAntenna);
+#if TDOA_ENABLE
+    // No modo calibração a âncora é iniciador de TWR
+    if (!calibration_ctx::b_calibration_mode)
+    {
+        DW1000Ranging.useTdoaBlinks(true);
+        if (ANCHOR_NUMBER == TDOA_REFERENCE_ANCHOR)
+        {
+            DW1000Ranging.useTdoaReference(TDOA_SYNC_PERIOD_MS);
+        }
+    }
+#endif
 
-    Serial.printf("Ancora ID: %X | Delay Antena: %d\n", DW1000_ANCHOR_SHORT_ADDRESS, delayAntenna);
+    DW1000.setAntennaDelay(calibration_ctx::antenna_delay);
+    DW1000Ranging.useDriftCompensation(DRIFT_SAMPLE_PERIOD_MS, DRIFT_TICKS_PER_DEGREE, calibration_ctx::reference_temp);
+
+    Serial.printf("Ancora ID: %X | Delay Antena: %d\n", DW1000_ANCHOR_SHORT_ADDRESS, calibration_ctx::antenna_delay);
 
     // --- PINAGEM DAS TASK's ---
     xTaskCreatePinnedToCore(task_network_routine, "NetTask", 4096, NULL, 1, &rtos_ctx::handle_task_network, 0);
@@ -151,10 +225,61 @@ void loop()
 void task_dw1000_routine(void *parameter)
 {
     Serial.println("[UWB] Task iniciada no Core 1");
+    // IRQ do DW1000 acorda esta task; sem IRQ dorme até o próximo prazo do protocolo
+    DW1000Ranging.useTaskNotification(xTaskGetCurrentTaskHandle());
     for (;;)
     {
         DW1000Ranging.loop();
-        vTaskDelay(pdMS_TO_TICKS(1));
+        DW1000Ranging.waitForEvent();
+
+        // Só entre trocas: POLL_ACK e RANGE de uma medida com o mesmo delay de antena
+        uint16_t new_delay = calibration_ctx::pending_antenna_delay;
+        if (new_delay != 0 && DW1000Ranging.isIdle())
+        {
+            calibration_ctx::pending_antenna_delay = 0;
+            calibration_ctx::antenna_delay = new_delay;
+            DW1000.setAntennaDelay(new_delay);
+
+            // O delay novo vale para a temperatura atual
+            float temperature = DW1000Ranging.getTemperature();
+            if (!isnan(temperature))
+            {
+                calibration_ctx::reference_temp = temperature;
+                Preferences cal_preferences;
+                cal_preferences.begin(NVS_CAL_NAMESPACE, NVS_READ_WRITE);
+                cal_preferences.putFloat(NVS_CAL_TEMPERATURE, temperature);
+                cal_preferences.end();
+                DW1000Ranging.useDriftCompensation(DRIFT_SAMPLE_PERIOD_MS, DRIFT_TICKS_PER_DEGREE, temperature);
+            }
+            Serial.printf("[CAL] Delay de antena aplicado: %d (%.1f °C)\n", new_delay, calibration_ctx::reference_temp);
+        }
+    }
+}
+
+// Delay de antena da NVS (senão a tabela do Defines.h) e modo calibração, que vale para um boot só
+void load_calibration()
+{
+    preferences.begin(NVS_CAL_NAMESPACE, NVS_READ_WRITE);
+    calibration_ctx::antenna_delay = preferences.getUShort(NVS_CAL_ANTENNA_DELAY, getAntennaDelayForAnchor(ANCHOR_NUMBER));
+    calibration_ctx::reference_temp = preferences.getFloat(NVS_CAL_TEMPERATURE, DRIFT_REFERENCE_TEMP_C);
+    calibration_ctx::b_calibration_mode = preferences.getBool(NVS_CAL_MODE, false);
+    if (calibration_ctx::b_calibration_mode)
+    {
+        preferences.putBool(NVS_CAL_MODE, false);
+    }
+    preferences.end();
+}
+
+// Fim do modo calibração ou comando de calibração: reinicia
+void manage_calibration()
+{
+    bool calibration_done = calibration_ctx::b_calibration_mode && millis() > CALIBRATION_DURATION_MS;
+    if (calibration_done || calibration_ctx::b_restart_requested)
+    {
+        Serial.println("[CAL] Reiniciando...");
+        // Margem para o último publish sair
+        vTaskDelay(pdMS_TO_TICKS(500));
+        esp_restart();
     }
 }
 
@@ -267,17 +392,43 @@ void retrive_and_publish_range()
             int len = snprintf(jsonBuffer, sizeof(jsonBuffer),
                                "{\"id_ancora\":%d,\"id_tag\":%d,\"distancia\":%.2f,"
                                "\"ax\":%d,\"ay\":%d,\"az\":%d,"
-                               "\"fp\":%.2f,\"rx\":%.2f,\"eta\":%.2f,\"quality\":%.2f}",
+                               "\"fp\":%.2f,\"rx\":%.2f,\"eta\":%.2f,\"quality\":%.2f,\"ts\":%lld,\"ts_imu\":%lld,"
+                               "\"ant_delay\":%u,\"cal\":%d,\"temp\":%.1f,\"vbat\":%.2f}",
                                received_range_pkg.anchor_id, received_range_pkg.tag_id, received_range_pkg.distance,
                                received_range_pkg.ax, received_range_pkg.ay, received_range_pkg.az,
                                received_range_pkg.fp_power, received_range_pkg.rp_power,
-                               received_range_pkg.eta, received_range_pkg.quality);
+                               received_range_pkg.eta, received_range_pkg.quality,
+                               (long long)received_range_pkg.timestamp_us,
+                               (long long)received_range_pkg.imu_timestamp_us, received_range_pkg.antenna_delay,
+                               calibration_ctx::b_calibration_mode ? 1 : 0,
+                               received_range_pkg.temperature, received_range_pkg.voltage);
 
             esp_mqtt_client_publish(mqtt_ctx::handle_mqtt_client, MQTT_TOPIC, jsonBuffer, len, 0, 0);
         }
     }
 }
 
+void retrive_and_publish_tdoa()
+{
+    TdoaSample sample;
+    char jsonBuffer[MAX_BUFFER_SIZE];
+
+    // Sem espera: os ranges também são publicados por esta task
+    while (xQueueReceive(rtos_ctx::tdoaQueue, &sample, 0) == pdPASS)
+    {
+        if (mqtt_ctx::b_mqtt_connected)
+        {
+            // ts: ticks do DW1000 (~15.65 ps) no relógio da âncora de referência, 40 bits
+            int len = snprintf(jsonBuffer, sizeof(jsonBuffer),
+                               "{\"id_ancora\":%d,\"id_tag\":%d,\"seq\":%u,\"ts\":%lld,\"sync\":%d,\"rx\":%.2f}",
+                               DW1000_ANCHOR_SHORT_ADDRESS, sample.tagAddress, sample.sequence,
+                               (long long)sample.timestamp, sample.synchronized ? 1 : 0, sample.rxPower);
+
+            esp_mqtt_client_publish(mqtt_ctx::handle_mqtt_client, mqtt_ctx::mqtt_tdoa_topic, jsonBuffer, len, 0, 0);
+        }
+    }
+}
+
 // --- TASK NETWORK (CORE 0) ---
 void task_network_routine(void *parameter)
 {
@@ -309,6 +460,10 @@ void task_network_routine(void *parameter)
 
         retrive_and_publish_range();
 
+        retrive_and_publish_tdoa();
+
+        manage_calibration();
+
         vTaskDelay(pdMS_TO_TICKS(1));
     }
 }
@@ -328,17 +483,34 @@ void new_range_callback(DW1000Device *device)
     
     range_pkg data;
 
-    data.anchor_id = DW1000_ANCHOR_SHORT_ADDRESS;
-    data.tag_id = device->getShortAddress();
+    if (calibration_ctx::b_calibration_mode)
+    {
+        // Esta âncora é o iniciador: o device é a outra âncora do par
+        data.anchor_id = device->getShortAddress();
+        data.tag_id = DW1000_ANCHOR_SHORT_ADDRESS;
+    }
+    else
+    {
+        data.anchor_id = DW1000_ANCHOR_SHORT_ADDRESS;
+        data.tag_id = device->getShortAddress();
+    }
+    // Delay efetivo (calibrado + compensação de temperatura): é com ele que o range foi medido,
+    // e é sobre ele que o calibrate.py soma a correção
+    data.antenna_delay = DW1000.getAntennaDelay() + DW1000.getAntennaDelayCompensation();
+    // Antes da primeira amostra (NAN) publica 0, o JSON não aceita nan
+    data.temperature = isnan(DW1000Ranging.getTemperature()) ? 0.0f : DW1000Ranging.getTemperature();
+    data.voltage = isnan(DW1000Ranging.getVoltage()) ? 0.0f : DW1000Ranging.getVoltage();
     data.distance = dist;
     data.rp_power = device->getRXPower();
     data.fp_power = device->getFPPower();
     data.quality = device->getQuality();
+    data.timestamp_us = DW1000Timebase::toMicroseconds(device->getRangeTimestamp());
 
     // Nota: Assume que a biblioteca DW1000 modificada expõe mpu_ax/ay/az
     data.ax = (int16_t)device->mpu_ax;
     data.ay = (int16_t)device->mpu_ay;
     data.az = (int16_t)device->mpu_az;
+    data.imu_timestamp_us = device->getImuTimestamp() != 0 ? DW1000Timebase::toMicroseconds(device->getImuTimestamp()) : 0;
 
 
     // Cálculo seguro de ETA
@@ -355,6 +527,12 @@ void new_range_callback(DW1000Device *device)
     xQueueOverwrite(rtos_ctx::uwbQueue, &data);
 }
 
+void tdoa_sample_callback(const TdoaSample &sample)
+{
+    // Fila cheia (rede lenta): descarta o BLINK, a task UWB não pode bloquear
+    xQueueSend(rtos_ctx::tdoaQueue, &sample, 0);
+}
+
 void new_device_callback(DW1000Device *device)
 {
     Serial.printf("Device Detectado: %X\n", device->getShortAddress());
@@ -393,7 +571,26 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
             JsonDocument doc;
             DeserializationError error = deserializeJson(doc, event->data, event->data_len);
             
-            if (!error)
+            // Instância própria: a task de rede usa a global ao mesmo tempo
+            Preferences cal_preferences;
+            if (!error && doc[NVS_CAL_ANTENNA_DELAY].is<uint16_t>())
+            {
+                uint16_t new_delay = doc[NVS_CAL_ANTENNA_DELAY];
+                cal_preferences.begin(NVS_CAL_NAMESPACE, NVS_READ_WRITE);
+                cal_preferences.putUShort(NVS_CAL_ANTENNA_DELAY, new_delay);
+                cal_preferences.end();
+                calibration_ctx::pending_antenna_delay = new_delay;
+                Serial.printf("[MQTT] Delay de antena salvo: %d\n", new_delay);
+            }
+            else if (!error && doc[NVS_CAL_MODE] == true)
+            {
+                cal_preferences.begin(NVS_CAL_NAMESPACE, NVS_READ_WRITE);
+                cal_preferences.putBool(NVS_CAL_MODE, true);
+                cal_preferences.end();
+                calibration_ctx::b_restart_requested = true;
+                Serial.println("[MQTT] Modo calibração solicitado");
+            }
+            else if (!error)
             {
                 const char *new_ssid = doc[NVS_WIFI_SSID];
                 const char *new_pass = doc[NVS_WIFI_PASS];
@@ -18,6 +18,7 @@
  * Arduino driver library (source file) for the Decawave DW1000 UWB transceiver IC.
  */
 
+#include <atomic>
 #include "DW1000.h"
 
 DW1000Class DW1000;
@@ -37,9 +38,27 @@ void (*DW1000Class::_handleReceived)(void) = 0;
 void (*DW1000Class::_handleReceiveFailed)(void) = 0;
 void (*DW1000Class::_handleReceiveTimeout)(void) = 0;
 void (*DW1000Class::_handleReceiveTimestampAvailable)(void) = 0;
+void (*DW1000Class::_handleLateTransmit)(void) = 0;
 
 // IRQ pending flag (set in ISR, processed in task context)
 volatile bool DW1000Class::_irqPending = false;
+TaskHandle_t volatile DW1000Class::_irqTask = nullptr;
+
+// interrupt event counters, single writer (handleInterrupt) and relaxed loads from any core
+static struct {
+	std::atomic<uint32_t> txDone{0};
+	std::atomic<uint32_t> rxOk{0};
+	std::atomic<uint32_t> rxCrcError{0};
+	std::atomic<uint32_t> rxError{0};
+	std::atomic<uint32_t> rxTimeout{0};
+	std::atomic<uint32_t> rxOverrun{0};
+	std::atomic<uint32_t> clockProblem{0};
+} g_eventCounters;
+
+static inline void countEvent(std::atomic<uint32_t> &counter)
+{
+	counter.fetch_add(1, std::memory_order_relaxed);
+}
 
 // registers
 byte DW1000Class::_syscfg[LEN_SYS_CFG];
@@ -64,6 +83,11 @@ byte DW1000Class::_preambleCode = PREAMBLE_CODE_16MHZ_4;
 byte DW1000Class::_channel = CHANNEL_5;
 DW1000Time DW1000Class::_antennaDelay;
 boolean DW1000Class::_antennaCalibrated = false;
+int16_t DW1000Class::_antennaDelayCompensation = 0;
+boolean DW1000Class::_doubleBuffering = false;
+boolean DW1000Class::_captureCarrierIntegrator = false;
+int32_t DW1000Class::_carrierIntegrator = 0;
+const DW1000Class::RangeBiasTable* DW1000Class::_rangeBias = &DW1000Class::RANGE_BIAS_500_16;
 boolean DW1000Class::_smartPower = false;
 
 boolean DW1000Class::_frameCheck = true;
@@ -94,6 +118,23 @@ constexpr byte DW1000Class::BIAS_500_16[];
 constexpr byte DW1000Class::BIAS_500_64[];
 constexpr byte DW1000Class::BIAS_900_16[];
 constexpr byte DW1000Class::BIAS_900_64[];
+// range bias [mm] to signed timestamp correction [1/256 tick], below the zero index the bias is negative
+static constexpr DW1000Class::RangeBiasTable expandRangeBias(const byte bias[], byte zero, int16_t mmPerUnit)
+{
+	DW1000Class::RangeBiasTable table = {};
+	for (byte i = 0; i < DW1000Class::LEN_BIAS_TABLE; i++)
+	{
+		float ticksQ8 = (i < zero ? -bias[i] : bias[i]) * mmPerUnit * DW1000Time::DISTANCE_OF_RADIO_INV * 0.001f * 256.0f;
+		table.ticksQ8[i] = (int16_t)(ticksQ8 < 0 ? ticksQ8 - 0.5f : ticksQ8 + 0.5f);
+	}
+	return table;
+}
+constexpr DW1000Class::RangeBiasTable DW1000Class::RANGE_BIAS_500_16 = expandRangeBias(BIAS_500_16, BIAS_500_16_ZERO, 1);
+constexpr DW1000Class::RangeBiasTable DW1000Class::RANGE_BIAS_500_64 = expandRangeBias(BIAS_500_64, BIAS_500_64_ZERO, 1);
+constexpr DW1000Class::RangeBiasTable DW1000Class::RANGE_BIAS_900_16 = expandRangeBias(BIAS_900_16, BIAS_900_16_ZERO, 2);
+constexpr DW1000Class::RangeBiasTable DW1000Class::RANGE_BIAS_900_64 = expandRangeBias(BIAS_900_64, BIAS_900_64_ZERO, 2);
+// table for the fixed point log2
+constexpr uint32_t DW1000Class::LOG2_TABLE[];
 /*
 const byte DW1000Class::BIAS_500_16[] = {198, 187, 179, 163, 143, 127, 109, 84, 59, 31, 0, 36, 65, 84, 97, 106, 110, 112};
 const byte DW1000Class::BIAS_500_64[] = {110, 105, 100, 93, 82, 69, 51, 27, 0, 21, 35, 42, 49, 62, 71, 76, 81, 86};
@@ -360,6 +401,15 @@ void DW1000Class::enableMode(const byte mode[])
 	setPreambleLength(mode[2]);
 }
 
+void DW1000Class::switchMode(const byte mode[])
+{
+	newConfiguration();
+	enableMode(mode);
+	// the preamble code depends on the PRF
+	setChannel(_channel);
+	commitConfiguration();
+}
+
 void DW1000Class::tune()
 {
 	// these registers are going to be tuned/configured
@@ -962,6 +1012,16 @@ void DW1000Class::tune()
 	writeBytes(FS_CTRL, FS_PLLTUNE_SUB, fsplltune, LEN_FS_PLLTUNE);
 	writeBytes(FS_CTRL, FS_PLLCFG_SUB, fspllcfg, LEN_FS_PLLCFG);
 	writeBytes(FS_CTRL, FS_XTALT_SUB, fsxtalt, LEN_FS_XTALT);
+	// range bias table used by correctTimestamp(), never null: the reserved PRF codes get the 16 MHz one
+	bool wideBand = _channel == CHANNEL_4 || _channel == CHANNEL_7;
+	if (_pulseFrequency == TX_PULSE_FREQ_64MHZ)
+	{
+		_rangeBias = wideBand ? &RANGE_BIAS_900_64 : &RANGE_BIAS_500_64;
+	}
+	else
+	{
+		_rangeBias = wideBand ? &RANGE_BIAS_900_16 : &RANGE_BIAS_500_16;
+	}
 }
 
 /* ###########################################################################
@@ -970,71 +1030,155 @@ void DW1000Class::tune()
 
 void DW1000Class::handleInterrupt()
 {
-	// read current status and handle via callbacks
+	// one status snapshot drives all callbacks and counters
 	readSystemEventStatusRegister();
-	if (isClockProblem() /* TODO and others */ && _handleError != 0)
+	if (isClockProblem())
 	{
-		(*_handleError)();
+		countEvent(g_eventCounters.clockProblem);
+		if (_handleError != 0)
+		{
+			(*_handleError)();
+		}
 	}
-	if (isTransmitDone() && _handleSent != 0)
+	if (isTransmitDone())
 	{
-		(*_handleSent)();
-		clearTransmitStatus();
+		countEvent(g_eventCounters.txDone);
+		if (_handleSent != 0)
+		{
+			(*_handleSent)();
+		}
 	}
 	if (isReceiveTimestampAvailable() && _handleReceiveTimestampAvailable != 0)
 	{
 		(*_handleReceiveTimestampAvailable)();
-		clearReceiveTimestampAvailableStatus();
 	}
-	if (isReceiveFailed() && _handleReceiveFailed != 0)
+	boolean overrun = isReceiveOverrun();
+	if (overrun)
 	{
-		(*_handleReceiveFailed)();
-		clearReceiveStatus();
-		if (_permanentReceive)
+		countEvent(g_eventCounters.rxOverrun);
+	}
+	boolean receiveEnded = true;
+	boolean receiveTimeout = false;
+	if (isReceiveFailed())
+	{
+		if (getBit(_sysstatus, LEN_SYS_STATUS, RXFCE_BIT))
 		{
-			newReceive();
-			startReceive();
+			countEvent(g_eventCounters.rxCrcError);
+		}
+		else
+		{
+			countEvent(g_eventCounters.rxError);
+		}
+		if (_handleReceiveFailed != 0)
+		{
+			(*_handleReceiveFailed)();
 		}
 	}
-	else if (isReceiveTimeout() && _handleReceiveTimeout != 0)
+	else if (isReceiveTimeout())
 	{
-		(*_handleReceiveTimeout)();
-		clearReceiveStatus();
-		if (_permanentReceive)
+		receiveTimeout = true;
+		countEvent(g_eventCounters.rxTimeout);
+		if (_handleReceiveTimeout != 0)
 		{
-			newReceive();
-			startReceive();
+			(*_handleReceiveTimeout)();
+		}
+	}
+	else if (isReceiveDone())
+	{
+		countEvent(g_eventCounters.rxOk);
+		if (_captureCarrierIntegrator)
+		{
+			// only valid until the receiver is enabled again, i.e. below
+			byte carrInt[LEN_DRX_CARRINT];
+			readBytes(DRX_TUNE, DRX_CARRINT_SUB, carrInt, LEN_DRX_CARRINT);
+			// 21 bit signed
+			int32_t value = (int32_t)carrInt[0] | ((int32_t)carrInt[1] << 8) | ((int32_t)(carrInt[2] & 0x1F) << 16);
+			_carrierIntegrator = (value & 0x100000) ? value - 0x200000 : value;
+		}
+		if (_handleReceived != 0)
+		{
+			(*_handleReceived)();
 		}
 	}
-	else if (isReceiveDone() && _handleReceived != 0)
+	else
+	{
+		receiveEnded = false;
+	}
+	// latched bits are reset by writing 1 to them: acknowledge exactly this snapshot in one write,
+	// events raised since the read stay pending
+	writeBytes(SYS_STATUS, NO_SUB, _sysstatus, LEN_SYS_STATUS);
+	if (overrun && _doubleBuffering)
 	{
-		(*_handleReceived)();
-		clearReceiveStatus();
+		// a third frame came in while both buffers were full, their content can't be trusted anymore
+		softResetReceiver();
+		syncReceiveBuffers();
 		if (_permanentReceive)
 		{
-			newReceive();
-			startReceive();
+			restartReceive();
 		}
 	}
-	// clear all status that is left unhandled
-	clearAllStatus();
+	else if (receiveEnded && _permanentReceive && (!_doubleBuffering || receiveTimeout))
+	{
+		// with double buffering the receiver re-enables itself after frames (RXAUTR)
+		restartReceive();
+	}
+	// the IRQ line is edge triggered, if it is still high a new event came in meanwhile
+	if (digitalRead(_irq) == HIGH)
+	{
+		_irqPending = true;
+	}
 }
 
-/* Lightweight ISR handler: only set a flag. Mark IRAM to be safe for ISR.
+void DW1000Class::restartReceive()
+{
+	// as newReceive() + startReceive(), status was already cleared by the caller
+	idle();
+	memset(_sysctrl, 0, LEN_SYS_CTRL);
+	_deviceMode = RX_MODE;
+	startReceive();
+}
+
+void DW1000Class::getEventCounters(EventCounters &counters)
+{
+	counters.txDone = g_eventCounters.txDone.load(std::memory_order_relaxed);
+	counters.rxOk = g_eventCounters.rxOk.load(std::memory_order_relaxed);
+	counters.rxCrcError = g_eventCounters.rxCrcError.load(std::memory_order_relaxed);
+	counters.rxError = g_eventCounters.rxError.load(std::memory_order_relaxed);
+	counters.rxTimeout = g_eventCounters.rxTimeout.load(std::memory_order_relaxed);
+	counters.rxOverrun = g_eventCounters.rxOverrun.load(std::memory_order_relaxed);
+	counters.clockProblem = g_eventCounters.clockProblem.load(std::memory_order_relaxed);
+}
+
+/* Lightweight ISR handler: only set a flag and wake the registered task. Mark IRAM to be safe for ISR.
    Actual processing is performed by processPendingInterrupt() in task context. */
 void IRAM_ATTR DW1000Class::irqHandler()
 {
 	_irqPending = true;
+	TaskHandle_t task = _irqTask;
+	if (task != nullptr)
+	{
+		BaseType_t higherPriorityTaskWoken = pdFALSE;
+		vTaskNotifyGiveFromISR(task, &higherPriorityTaskWoken);
+		portYIELD_FROM_ISR(higherPriorityTaskWoken);
+	}
 }
 
 /* Called from non-ISR context to handle any pending IRQs. */
 void DW1000Class::processPendingInterrupt()
 {
-	if (_irqPending)
+	// the IRQ line may stay high (re-latching PLL status, a bit not cleared, no chip or a floating pin):
+	// a few passes only, then the rest comes with the next call so loop() and the other tasks go on
+	constexpr uint8_t maxPasses = 4;
+	for (uint8_t pass = 0; pass < maxPasses && _irqPending; pass++)
 	{
 		_irqPending = false;
 		handleInterrupt();
 	}
+	TaskHandle_t task = _irqTask;
+	if (_irqPending && task != nullptr)
+	{
+		xTaskNotifyGive(task);
+	}
 }
 
 /* ###########################################################################
@@ -1324,9 +1468,41 @@ void DW1000Class::setFrameFilterAllowReserved(boolean val)
 
 void DW1000Class::setDoubleBuffering(boolean val)
 {
+	_doubleBuffering = val;
 	setBit(_syscfg, LEN_SYS_CFG, DIS_DRXB_BIT, !val);
 }
 
+void DW1000Class::releaseReceiveBuffer()
+{
+	if (!_doubleBuffering)
+	{
+		return;
+	}
+	byte toggle = 1 << (HRBPT_BIT % 8);
+	writeBytes(SYS_CTRL, HRBPT_BIT / 8, &toggle, 1);
+}
+
+void DW1000Class::syncReceiveBuffers()
+{
+	byte status;
+	readBytes(SYS_STATUS, HSRBP_BIT / 8, &status, 1);
+	if (getBit(&status, 1, HSRBP_BIT % 8) != getBit(&status, 1, ICRBP_BIT % 8))
+	{
+		byte toggle = 1 << (HRBPT_BIT % 8);
+		writeBytes(SYS_CTRL, HRBPT_BIT / 8, &toggle, 1);
+	}
+}
+
+void DW1000Class::softResetReceiver()
+{
+	// RX reset bit (SOFTRESET bit 28) low and back high, the receiver must be off
+	idle();
+	byte softReset = 0xE0;
+	writeBytes(PMSC, PMSC_CTRL0_SUB + 3, &softReset, 1);
+	softReset = 0xF0;
+	writeBytes(PMSC, PMSC_CTRL0_SUB + 3, &softReset, 1);
+}
+
 void DW1000Class::setInterruptPolarity(boolean val)
 {
 	setBit(_syscfg, LEN_SYS_CFG, HIRQ_POL_BIT, val);
@@ -1373,7 +1549,7 @@ void DW1000Class::interruptOnAutomaticAcknowledgeTrigger(boolean val)
 
 void DW1000Class::setAntennaDelay(const uint16_t value)
 {
-	_antennaDelay.setTimestamp(value);
+	_antennaDelay.setTimestamp(value + _antennaDelayCompensation);
 	_antennaCalibrated = true;
 	// added by SJR -- commit to device register (see function commitConfiguration())
 	byte antennaDelayBytes[DW1000Time::LENGTH_TIMESTAMP];
@@ -1385,7 +1561,23 @@ void DW1000Class::setAntennaDelay(const uint16_t value)
 
 uint16_t DW1000Class::getAntennaDelay()
 {
-	return static_cast<uint16_t>(_antennaDelay.getTimestamp());
+	return static_cast<uint16_t>(_antennaDelay.getTimestamp() - _antennaDelayCompensation);
+}
+
+void DW1000Class::setAntennaDelayCompensation(int16_t ticks)
+{
+	if (ticks == _antennaDelayCompensation)
+	{
+		return;
+	}
+	uint16_t calibrated = getAntennaDelay();
+	_antennaDelayCompensation = ticks;
+	if (!_antennaCalibrated)
+	{
+		// applied with the default delay in commitConfiguration()
+		return;
+	}
+	setAntennaDelay(calibrated);
 }
 
 void DW1000Class::clearInterrupts()
@@ -1426,20 +1618,38 @@ void DW1000Class::newTransmit()
 
 void DW1000Class::startTransmit()
 {
+	boolean delayed = getBit(_sysctrl, LEN_SYS_CTRL, TXDLYS_BIT);
+	boolean waitResponse = getBit(_sysctrl, LEN_SYS_CTRL, WAIT4RESP_BIT);
 	writeTransmitFrameControlRegister();
 	setBit(_sysctrl, LEN_SYS_CTRL, SFCST_BIT, !_frameCheck);
 	setBit(_sysctrl, LEN_SYS_CTRL, TXSTRT_BIT, true);
 	writeBytes(SYS_CTRL, NO_SUB, _sysctrl, LEN_SYS_CTRL);
+	// a delayed start behind DX_TIME would only go out after a full timer period (~17 s)
+	boolean late = delayed && isTransmitLate();
+	if (late)
+	{
+		idle();
+		byte hpdwarn = 1 << (HPDWARN_BIT % 8);
+		writeBytes(SYS_STATUS, HPDWARN_BIT / 8, &hpdwarn, 1);
+	}
 	if (_permanentReceive)
 	{
 		memset(_sysctrl, 0, LEN_SYS_CTRL);
 		_deviceMode = RX_MODE;
-		startReceive();
+		// waiting for a response the chip enables the receiver by itself once the frame is sent
+		if (!waitResponse || late)
+		{
+			startReceive();
+		}
 	}
 	else
 	{
 		_deviceMode = IDLE_MODE;
 	}
+	if (late && _handleLateTransmit != 0)
+	{
+		(*_handleLateTransmit)();
+	}
 }
 
 void DW1000Class::newConfiguration()
@@ -1466,7 +1676,7 @@ void DW1000Class::commitConfiguration()
 	byte antennaDelayBytes[DW1000Time::LENGTH_TIMESTAMP];
 	if (_antennaDelay.getTimestamp() == 0 && _antennaCalibrated == false)
 	{
-		_antennaDelay.setTimestamp(16384);
+		_antennaDelay.setTimestamp(16384 + _antennaDelayCompensation);
 		_antennaCalibrated = true;
 	} // Compatibility with old versions.
 	_antennaDelay.getTimestamp(antennaDelayBytes);
@@ -1520,6 +1730,31 @@ DW1000Time DW1000Class::setDelay(const DW1000Time &delay)
 	return futureTime;
 }
 
+DW1000Time DW1000Class::setDelay(const DW1000Duration &delay)
+{
+	return setDelay(DW1000Time(delay.getTicks()));
+}
+
+DW1000Time DW1000Class::scheduleTxAt(const DW1000Time &txTime)
+{
+	if (_deviceMode != TX_MODE)
+	{
+		// only transmissions can be anchored, ignore
+		return DW1000Time();
+	}
+	setBit(_sysctrl, LEN_SYS_CTRL, TXDLYS_BIT, true);
+	// the chip adds the antenna delay on top of DX_TIME and ignores its low 9 bits
+	byte delayBytes[LEN_DX_TIME];
+	DW1000Time dxTime = txTime - _antennaDelay;
+	dxTime.getTimestamp(delayBytes);
+	delayBytes[0] = 0;
+	delayBytes[1] &= 0xFE;
+	writeBytes(DX_TIME, NO_SUB, delayBytes, LEN_DX_TIME);
+	dxTime.setTimestamp(delayBytes);
+	dxTime += _antennaDelay;
+	return dxTime;
+}
+
 void DW1000Class::setDataRate(byte rate)
 {
 	rate &= 0x03;
@@ -1616,6 +1851,72 @@ void DW1000Class::useExtendedFrameLength(boolean val)
 	_syscfg[2] |= _extendedFrameLength;
 }
 
+void DW1000Class::setReceiveFrameWaitTimeout(uint32_t micros)
+{
+	// the timeout counts in units of 512 / 499.2 MHz (~1.026 us)
+	uint32_t units = (micros * 4992UL + 5119UL) / 5120UL;
+	if (units > 0xFFFF)
+	{
+		units = 0xFFFF;
+	}
+	byte fwto[LEN_RX_FWTO];
+	writeValueToBytes(fwto, units, LEN_RX_FWTO);
+	writeBytes(RX_FWTO, NO_SUB, fwto, LEN_RX_FWTO);
+	setBit(_syscfg, LEN_SYS_CFG, RXWTOE_BIT, units != 0);
+	writeSystemConfigurationRegister();
+}
+
+uint32_t DW1000Class::getFrameAirtime(uint16_t length)
+{
+	const byte mode[] = {_dataRate, _pulseFrequency, _preambleLength};
+	return getFrameAirtime(length, mode);
+}
+
+uint32_t DW1000Class::getFrameAirtime(uint16_t length, const byte mode[])
+{
+	// see DW1000 User Manual, section 3.4 (frame format) and table 15 (symbol durations), times in ns
+	uint32_t preambleSymbols;
+	switch (mode[2])
+	{
+	case TX_PREAMBLE_LEN_64: preambleSymbols = 64; break;
+	case TX_PREAMBLE_LEN_128: preambleSymbols = 128; break;
+	case TX_PREAMBLE_LEN_256: preambleSymbols = 256; break;
+	case TX_PREAMBLE_LEN_512: preambleSymbols = 512; break;
+	case TX_PREAMBLE_LEN_1024: preambleSymbols = 1024; break;
+	case TX_PREAMBLE_LEN_1536: preambleSymbols = 1536; break;
+	case TX_PREAMBLE_LEN_2048: preambleSymbols = 2048; break;
+	default: preambleSymbols = 4096; break;
+	}
+	uint32_t symbolNs = (mode[1] == TX_PULSE_FREQ_64MHZ) ? 1018 : 994;
+	// SFD length as written by enableMode(), PHR is always 21 bits, data at 110 kb/s on 850 kb/s PHR
+	uint32_t sfdSymbols;
+	uint32_t phrBitNs;
+	uint32_t dataBitNs;
+	if (mode[0] == TRX_RATE_110KBPS)
+	{
+		sfdSymbols = 64;
+		phrBitNs = 8205;
+		dataBitNs = 8205;
+	}
+	else if (mode[0] == TRX_RATE_850KBPS)
+	{
+		sfdSymbols = 16;
+		phrBitNs = 1026;
+		dataBitNs = 1026;
+	}
+	else
+	{
+		sfdSymbols = 8;
+		phrBitNs = 1026;
+		dataBitNs = 128;
+	}
+	// data and CRC, plus 48 Reed-Solomon parity bits for each block of 330 bits
+	uint32_t dataBits = (length + 2) * 8UL;
+	dataBits += (dataBits + 329) / 330 * 48;
+	uint32_t airtimeNs = (preambleSymbols + sfdSymbols) * symbolNs + 21 * phrBitNs + dataBits * dataBitNs;
+	return (airtimeNs + 999) / 1000;
+}
+
 void DW1000Class::receivePermanently(boolean val)
 {
 	_permanentReceive = val;
@@ -1714,6 +2015,8 @@ void DW1000Class::setDefaults()
 		interruptOnSent(true);
 		interruptOnReceived(true);
 		interruptOnReceiveFailed(true);
+		// only fires when a frame wait timeout is set
+		interruptOnReceiveTimeout(true);
 		interruptOnReceiveTimestampAvailable(false);
 		interruptOnAutomaticAcknowledgeTrigger(true);
 		setReceiverAutoReenable(true);
@@ -1834,74 +2137,36 @@ void DW1000Class::getReceiveTimestamp(DW1000Time &time)
 	correctTimestamp(time);
 }
 
-// TODO check function, different type violations between byte and int
 void DW1000Class::correctTimestamp(DW1000Time &timestamp)
 {
+	correctTimestamp(timestamp, getReceivePower());
+}
+
+void DW1000Class::correctTimestamp(DW1000Time &timestamp, float rxPower)
+{
+	const int16_t *ticksQ8 = _rangeBias->ticksQ8;
 	// base line dBm, which is -61, 2 dBm steps, total 18 data points (down to -95 dBm)
-	float rxPowerBase = -(getReceivePower() + 61.0f) * 0.5f;
-	int16_t rxPowerBaseLow = (int16_t)rxPowerBase; // TODO check type
-	int16_t rxPowerBaseHigh = rxPowerBaseLow + 1;  // TODO check type
-	if (rxPowerBaseLow <= 0)
+	float rxPowerBase = -(rxPower + 61.0f) * 0.5f;
+	int32_t rangeBiasQ8;
+	if (rxPowerBase < 1.0f)
 	{
-		rxPowerBaseLow = 0;
-		rxPowerBaseHigh = 0;
+		rangeBiasQ8 = ticksQ8[0];
 	}
-	else if (rxPowerBaseHigh >= 17)
+	else if (!(rxPowerBase < LEN_BIAS_TABLE - 2))
 	{
-		rxPowerBaseLow = 17;
-		rxPowerBaseHigh = 17;
-	}
-	// select range low/high values from corresponding table
-	int16_t rangeBiasHigh;
-	int16_t rangeBiasLow;
-	if (_channel == CHANNEL_4 || _channel == CHANNEL_7)
-	{
-		// 900 MHz receiver bandwidth
-		if (_pulseFrequency == TX_PULSE_FREQ_16MHZ)
-		{
-			rangeBiasHigh = (rxPowerBaseHigh < BIAS_900_16_ZERO ? -BIAS_900_16[rxPowerBaseHigh] : BIAS_900_16[rxPowerBaseHigh]);
-			rangeBiasHigh <<= 1;
-			rangeBiasLow = (rxPowerBaseLow < BIAS_900_16_ZERO ? -BIAS_900_16[rxPowerBaseLow] : BIAS_900_16[rxPowerBaseLow]);
-			rangeBiasLow <<= 1;
-		}
-		else if (_pulseFrequency == TX_PULSE_FREQ_64MHZ)
-		{
-			rangeBiasHigh = (rxPowerBaseHigh < BIAS_900_64_ZERO ? -BIAS_900_64[rxPowerBaseHigh] : BIAS_900_64[rxPowerBaseHigh]);
-			rangeBiasHigh <<= 1;
-			rangeBiasLow = (rxPowerBaseLow < BIAS_900_64_ZERO ? -BIAS_900_64[rxPowerBaseLow] : BIAS_900_64[rxPowerBaseLow]);
-			rangeBiasLow <<= 1;
-		}
-		else
-		{
-			// TODO proper error handling
-			return;
-		}
+		// also catches -inf dBm of an empty accumulator
+		rangeBiasQ8 = ticksQ8[LEN_BIAS_TABLE - 1];
 	}
 	else
 	{
-		// 500 MHz receiver bandwidth
-		if (_pulseFrequency == TX_PULSE_FREQ_16MHZ)
-		{
-			rangeBiasHigh = (rxPowerBaseHigh < BIAS_500_16_ZERO ? -BIAS_500_16[rxPowerBaseHigh] : BIAS_500_16[rxPowerBaseHigh]);
-			rangeBiasLow = (rxPowerBaseLow < BIAS_500_16_ZERO ? -BIAS_500_16[rxPowerBaseLow] : BIAS_500_16[rxPowerBaseLow]);
-		}
-		else if (_pulseFrequency == TX_PULSE_FREQ_64MHZ)
-		{
-			rangeBiasHigh = (rxPowerBaseHigh < BIAS_500_64_ZERO ? -BIAS_500_64[rxPowerBaseHigh] : BIAS_500_64[rxPowerBaseHigh]);
-			rangeBiasLow = (rxPowerBaseLow < BIAS_500_64_ZERO ? -BIAS_500_64[rxPowerBaseLow] : BIAS_500_64[rxPowerBaseLow]);
-		}
-		else
-		{
-			// TODO proper error handling
-			return;
-		}
+		// linear interpolation of bias values, index and fraction in Q8
+		uint16_t rxPowerBaseQ8 = (uint16_t)(rxPowerBase * 256.0f);
+		uint8_t low = rxPowerBaseQ8 >> 8;
+		rangeBiasQ8 = ticksQ8[low] + (((int32_t)(ticksQ8[low + 1] - ticksQ8[low]) * (rxPowerBaseQ8 & 0xFF)) >> 8);
 	}
-	// linear interpolation of bias values
-	float rangeBias = rangeBiasLow + (rxPowerBase - rxPowerBaseLow) * (rangeBiasHigh - rangeBiasLow);
-	// range bias [mm] to timestamp modification value conversion
-	DW1000Time adjustmentTime;
-	adjustmentTime.setTimestamp((int16_t)(rangeBias * DW1000Time::DISTANCE_OF_RADIO_INV * 0.001f));
 	// apply correction
+	DW1000Time adjustmentTime;
+	adjustmentTime.setTimestamp((int64_t)(rangeBiasQ8 / 256));
 	timestamp -= adjustmentTime;
 }
 
@@ -1932,6 +2197,19 @@ boolean DW1000Class::isTransmitDone()
 	return getBit(_sysstatus, LEN_SYS_STATUS, TXFRS_BIT);
 }
 
+boolean DW1000Class::isReceiveOverrun()
+{
+	return getBit(_sysstatus, LEN_SYS_STATUS, RXOVRR_BIT);
+}
+
+boolean DW1000Class::isTransmitLate()
+{
+	// only the status byte holding HPDWARN, read right after the delayed start
+	byte status;
+	readBytes(SYS_STATUS, HPDWARN_BIT / 8, &status, 1);
+	return getBit(&status, 1, HPDWARN_BIT % 8);
+}
+
 boolean DW1000Class::isReceiveTimestampAvailable()
 {
 	return getBit(_sysstatus, LEN_SYS_STATUS, LDEDONE_BIT);
@@ -2014,6 +2292,69 @@ void DW1000Class::clearTransmitStatus()
 	writeBytes(SYS_STATUS, NO_SUB, _sysstatus, LEN_SYS_STATUS);
 }
 
+void DW1000Class::getRxDiagnostics(RxDiagnostics &diag)
+{
+	// three register reads cover everything the per-frame consumers need
+	byte rxFrameInfo[LEN_RX_FINFO];
+	byte rxFrameQuality[LEN_RX_FQUAL];
+	byte rxTime[LEN_RX_TIME];
+	readBytes(RX_FINFO, NO_SUB, rxFrameInfo, LEN_RX_FINFO);
+	readBytes(RX_FQUAL, NO_SUB, rxFrameQuality, LEN_RX_FQUAL);
+	readBytes(RX_TIME, NO_SUB, rxTime, LEN_RX_TIME);
+	diag.dataLength = ((((uint16_t)rxFrameInfo[1] << 8) | (uint16_t)rxFrameInfo[0]) & 0x03FF);
+	if (_frameCheck && diag.dataLength > 2)
+	{
+		diag.dataLength -= 2;
+	}
+	diag.preambleCount = (((uint16_t)rxFrameInfo[2] >> 4) & 0xFF) | ((uint16_t)rxFrameInfo[3] << 4);
+	diag.stdNoise = (uint16_t)rxFrameQuality[STD_NOISE_SUB] | ((uint16_t)rxFrameQuality[STD_NOISE_SUB + 1] << 8);
+	diag.fpAmpl2 = (uint16_t)rxFrameQuality[FP_AMPL2_SUB] | ((uint16_t)rxFrameQuality[FP_AMPL2_SUB + 1] << 8);
+	diag.fpAmpl3 = (uint16_t)rxFrameQuality[FP_AMPL3_SUB] | ((uint16_t)rxFrameQuality[FP_AMPL3_SUB + 1] << 8);
+	diag.cirPower = (uint16_t)rxFrameQuality[CIR_PWR_SUB] | ((uint16_t)rxFrameQuality[CIR_PWR_SUB + 1] << 8);
+	diag.fpAmpl1 = (uint16_t)rxTime[FP_AMPL1_SUB] | ((uint16_t)rxTime[FP_AMPL1_SUB + 1] << 8);
+	// derived values, no further SPI traffic from here on
+	diag.rxPower = computeReceivePower(diag.cirPower, diag.preambleCount);
+	diag.fpPower = computeFirstPathPower(diag.fpAmpl1, diag.fpAmpl2, diag.fpAmpl3, diag.preambleCount);
+	diag.quality = (float)diag.fpAmpl2 / diag.stdNoise;
+	diag.timestamp.setTimestamp(rxTime + RX_STAMP_SUB);
+	correctTimestamp(diag.timestamp, diag.rxPower);
+	diag.carrierIntegrator = _captureCarrierIntegrator ? _carrierIntegrator : 0;
+	diag.clockOffset = computeClockOffset(diag.carrierIntegrator);
+}
+
+float DW1000Class::computeClockOffset(int32_t carrierIntegrator)
+{
+	// carrier frequency offset [Hz] relative to the channel centre frequency
+	float offsetHz;
+	if (_dataRate == TRX_RATE_110KBPS)
+	{
+		offsetHz = carrierIntegrator * CARRINT_TO_HZ_110KBPS;
+	}
+	else
+	{
+		offsetHz = carrierIntegrator * CARRINT_TO_HZ;
+	}
+	float carrierHz;
+	switch (_channel)
+	{
+	case CHANNEL_1:
+		carrierHz = 3494.4e6f;
+		break;
+	case CHANNEL_2:
+	case CHANNEL_4:
+		carrierHz = 3993.6e6f;
+		break;
+	case CHANNEL_3:
+		carrierHz = 4492.8e6f;
+		break;
+	default:
+		carrierHz = 6489.6e6f;
+		break;
+	}
+	// a positive integrator means the sender is slower than our clock
+	return -offsetHz / carrierHz;
+}
+
 float DW1000Class::getReceiveQuality()
 {
 	byte noiseBytes[LEN_STD_NOISE];
@@ -2033,7 +2374,6 @@ float DW1000Class::getFirstPathPower()
 	byte fpAmpl3Bytes[LEN_FP_AMPL3];
 	byte rxFrameInfo[LEN_RX_FINFO];
 	uint16_t f1, f2, f3, N;
-	float A, corrFac;
 	readBytes(RX_TIME, FP_AMPL1_SUB, fpAmpl1Bytes, LEN_FP_AMPL1);
 	readBytes(RX_FQUAL, FP_AMPL2_SUB, fpAmpl2Bytes, LEN_FP_AMPL2);
 	readBytes(RX_FQUAL, FP_AMPL3_SUB, fpAmpl3Bytes, LEN_FP_AMPL3);
@@ -2042,6 +2382,21 @@ float DW1000Class::getFirstPathPower()
 	f2 = (uint16_t)fpAmpl2Bytes[0] | ((uint16_t)fpAmpl2Bytes[1] << 8);
 	f3 = (uint16_t)fpAmpl3Bytes[0] | ((uint16_t)fpAmpl3Bytes[1] << 8);
 	N = (((uint16_t)rxFrameInfo[2] >> 4) & 0xFF) | ((uint16_t)rxFrameInfo[3] << 4);
+	return computeFirstPathPower(f1, f2, f3, N);
+}
+
+float DW1000Class::computeFirstPathPower(uint16_t f1, uint16_t f2, uint16_t f3, uint16_t N)
+{
+#if DW1000_FIXED_POINT_RX_POWER
+	uint64_t ampl = (uint64_t)f1 * f1 + (uint64_t)f2 * f2 + (uint64_t)f3 * f3;
+	if (ampl == 0 || N == 0)
+	{
+		return -INFINITY;
+	}
+	// 10 * log10((f1^2 + f2^2 + f3^2) / N^2) - A
+	return powerFromLog2Q16(log2Q16(ampl) - 2 * log2Q16(N));
+#else
+	float A, corrFac;
 	if (_pulseFrequency == TX_PULSE_FREQ_16MHZ)
 	{
 		A = 113.77;
@@ -2063,19 +2418,33 @@ float DW1000Class::getFirstPathPower()
 		estFpPwr += (estFpPwr + 88) * corrFac;
 	}
 	return estFpPwr;
+#endif
 }
 
 float DW1000Class::getReceivePower()
 {
 	byte cirPwrBytes[LEN_CIR_PWR];
 	byte rxFrameInfo[LEN_RX_FINFO];
-	uint32_t twoPower17 = 131072;
 	uint16_t C, N;
-	float A, corrFac;
 	readBytes(RX_FQUAL, CIR_PWR_SUB, cirPwrBytes, LEN_CIR_PWR);
 	readBytes(RX_FINFO, NO_SUB, rxFrameInfo, LEN_RX_FINFO);
 	C = (uint16_t)cirPwrBytes[0] | ((uint16_t)cirPwrBytes[1] << 8);
 	N = (((uint16_t)rxFrameInfo[2] >> 4) & 0xFF) | ((uint16_t)rxFrameInfo[3] << 4);
+	return computeReceivePower(C, N);
+}
+
+float DW1000Class::computeReceivePower(uint16_t C, uint16_t N)
+{
+#if DW1000_FIXED_POINT_RX_POWER
+	if (C == 0 || N == 0)
+	{
+		return -INFINITY;
+	}
+	// 10 * log10(C * 2^17 / N^2) - A
+	return powerFromLog2Q16(log2Q16(C) + (17 << 16) - 2 * log2Q16(N));
+#else
+	uint32_t twoPower17 = 131072;
+	float A, corrFac;
 	if (_pulseFrequency == TX_PULSE_FREQ_16MHZ)
 	{
 		A = 113.77;
@@ -2097,6 +2466,56 @@ float DW1000Class::getReceivePower()
 		estRxPwr += (estRxPwr + 88) * corrFac;
 	}
 	return estRxPwr;
+#endif
+}
+
+/*
+ * Turns log2 of the power ratio (Q16) into the estimated power in dBm,
+ * including the PRF constant A and the correction of Fig. 22 in the user
+ * manual, using integer arithmetic only.
+ * @param log2Value
+ *		log2 of the power ratio in Q16.
+ */
+float DW1000Class::powerFromLog2Q16(int32_t log2Value)
+{
+	int32_t A, corrFac;
+	if (_pulseFrequency == TX_PULSE_FREQ_16MHZ)
+	{
+		A = RX_POWER_A_16MHZ_Q8;
+		corrFac = RX_POWER_CORR_16MHZ_Q12;
+	}
+	else
+	{
+		A = RX_POWER_A_64MHZ_Q8;
+		corrFac = RX_POWER_CORR_64MHZ_Q12;
+	}
+	int32_t estPwr = (int32_t)(((int64_t)log2Value * LOG2_Q16_TO_DB_Q8) >> 24) - A;
+	if (estPwr > -88 * 256)
+	{
+		// approximation of Fig. 22 in user manual for dbm correction
+		estPwr += ((estPwr + 88 * 256) * corrFac) >> 12;
+	}
+	return estPwr / 256.0f;
+}
+
+/*
+ * Fixed point log2 from the position of the leading one plus a table of
+ * log2(1 + x) for the mantissa.
+ * @param value
+ *		The value to take the logarithm of, must not be 0.
+ * @return
+ *		log2(value) in Q16.
+ */
+int32_t DW1000Class::log2Q16(uint64_t value)
+{
+	int32_t msb = 63 - __builtin_clzll(value);
+	// mantissa with 20 fractional bits, 1.0 <= mantissa < 2.0
+	uint32_t frac = (uint32_t)(msb >= 20 ? value >> (msb - 20) : value << (20 - msb)) & 0xFFFFF;
+	// top 5 bits select the table segment, the remaining 15 bits interpolate
+	uint8_t idx = frac >> 15;
+	int32_t lo = LOG2_TABLE[idx];
+	int32_t hi = LOG2_TABLE[idx + 1];
+	return (msb << 16) + lo + (((hi - lo) * (int32_t)(frac & 0x7FFF)) >> 15);
 }
 
 /* ###########################################################################
@@ -2174,6 +2593,9 @@ void DW1000Class::writeValueToBytes(byte data[], int32_t val, uint16_t n)
 
 /*
  * Read bytes from the DW1000. Number of bytes depend on register length.
+ * The access is clocked in bursts of up to SPI_BURST_LEN bytes through a
+ * word-aligned bounce buffer (the ESP32 SPI FIFO is filled word-wise and
+ * must not be handed arbitrary byte pointers), all within one CS frame.
  * @param cmd
  * 		The register address (see Chapter 7 in the DW1000 user manual).
  * @param data
@@ -2208,17 +2630,26 @@ void DW1000Class::readBytes(byte cmd, uint16_t offset, byte data[], uint16_t n)
 			headerLen += 2;
 		}
 	}
+	// first burst carries the header followed by as many data bytes as fit into
+	// the bounce buffer, the bytes clocked in during the header are discarded
+	uint32_t burst[SPI_BURST_LEN / 4];
+	byte *burstBytes = (byte *)burst;
+	uint16_t chunk = min((uint16_t)(SPI_BURST_LEN - headerLen), n);
+	memcpy(burstBytes, header, headerLen);
+	memset(burstBytes + headerLen, JUNK, chunk);
 	SPI.beginTransaction(*_currentSPI);
 	digitalWrite(_ss, LOW);
-	for (i = 0; i < headerLen; i++)
+	SPI.transferBytes(burstBytes, burstBytes, headerLen + chunk);
+	memcpy(data, burstBytes + headerLen, chunk);
+	for (i = chunk; i < n; i += chunk)
 	{
-		SPI.transfer(header[i]); // send header
+		chunk = min((uint16_t)SPI_BURST_LEN, (uint16_t)(n - i));
+		SPI.transferBytes(nullptr, burstBytes, chunk); // read values
+		memcpy(data + i, burstBytes, chunk);
 	}
-	for (i = 0; i < n; i++)
-	{
-		data[i] = SPI.transfer(JUNK); // read values
-	}
-	delayMicroseconds(5);
+#if DW1000_SPI_CS_HOLD_US > 0
+	delayMicroseconds(DW1000_SPI_CS_HOLD_US);
+#endif
 	digitalWrite(_ss, HIGH);
 	SPI.endTransaction();
 }
@@ -2291,17 +2722,24 @@ void DW1000Class::writeBytes(byte cmd, uint16_t offset, byte data[], uint16_t da
 			headerLen += 2;
 		}
 	}
+	// header and the first data bytes leave in one burst
+	uint32_t burst[SPI_BURST_LEN / 4];
+	byte *burstBytes = (byte *)burst;
+	uint16_t chunk = min((uint16_t)(SPI_BURST_LEN - headerLen), data_size);
+	memcpy(burstBytes, header, headerLen);
+	memcpy(burstBytes + headerLen, data, chunk);
 	SPI.beginTransaction(*_currentSPI);
 	digitalWrite(_ss, LOW);
-	for (i = 0; i < headerLen; i++)
+	SPI.writeBytes(burstBytes, headerLen + chunk);
+	for (i = chunk; i < data_size; i += chunk)
 	{
-		SPI.transfer(header[i]); // send header
+		chunk = min((uint16_t)SPI_BURST_LEN, (uint16_t)(data_size - i));
+		memcpy(burstBytes, data + i, chunk);
+		SPI.writeBytes(burstBytes, chunk); // write values
 	}
-	for (i = 0; i < data_size; i++)
-	{
-		SPI.transfer(data[i]); // write values
-	}
-	delayMicroseconds(5);
+#if DW1000_SPI_CS_HOLD_US > 0
+	delayMicroseconds(DW1000_SPI_CS_HOLD_US);
+#endif
 	digitalWrite(_ss, HIGH);
 	SPI.endTransaction();
 }
@@ -22,7 +22,6 @@
  * - TXBOFFS in TX_FCTRL for offset buffer transmit
  * - TR in TX_FCTRL for flagging for ranging messages
  * - CANSFCS in SYS_CTRL to cancel frame check suppression
- * - HSRBP in SYS_CTRL to determine in double buffered mode from which buffer to read
  */
 
 #ifndef _DW1000_H_INCLUDED
@@ -33,9 +32,42 @@
 #include <string.h>
 #include <Arduino.h>
 #include <SPI.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include "DW1000Constants.h"
 #include "DW1000Time.h"
 
+/* Receive diagnostics of the last frame, filled by DW1000Class::getRxDiagnostics(). */
+struct RxDiagnostics {
+	/* raw register values */
+	uint16_t dataLength;    // RX_FINFO frame length w/o the two FCS bytes
+	uint16_t preambleCount; // RX_FINFO RXPACC
+	uint16_t stdNoise;      // RX_FQUAL STD_NOISE
+	uint16_t fpAmpl1;       // RX_TIME FP_AMPL1
+	uint16_t fpAmpl2;       // RX_FQUAL FP_AMPL2
+	uint16_t fpAmpl3;       // RX_FQUAL FP_AMPL3
+	uint16_t cirPower;      // RX_FQUAL CIR_PWR
+	/* derived values */
+	float      rxPower;   // as getReceivePower()
+	float      fpPower;   // as getFirstPathPower()
+	float      quality;   // as getReceiveQuality()
+	DW1000Time timestamp; // as getReceiveTimestamp(), range bias corrected
+	/* only with captureCarrierIntegrator(true), else 0 */
+	int32_t carrierIntegrator; // DRX_CAR_INT, latched when the frame was received
+	float   clockOffset;       // remote vs local clock rate ratio, > 0 if the local clock is slower
+};
+
+/* Event counters since begin(), updated by DW1000Class::handleInterrupt(), see getEventCounters(). */
+struct EventCounters {
+	uint32_t txDone;       // TXFRS
+	uint32_t rxOk;         // RXFCG (RXDFR without frame check)
+	uint32_t rxCrcError;   // RXFCE
+	uint32_t rxError;      // RXPHE, RXRFSL or LDEERR without CRC error
+	uint32_t rxTimeout;    // RXRFTO, RXPTO or RXSFDTO
+	uint32_t rxOverrun;    // RXOVRR
+	uint32_t clockProblem; // CLKPLL_LL or RFPLL_LL
+};
+
 class DW1000Class {
 public:
 	/* ##### Init ################################################################ */
@@ -241,7 +273,39 @@ public:
 	
 	/* transmit and receive configuration. */
 	static DW1000Time   setDelay(const DW1000Time& delay);
+	static DW1000Time   setDelay(const DW1000Duration& delay);
+	/** 
+	Schedules the next transmission at an absolute time of the system clock, typically the
+	timestamp of the received frame plus the reply time. Unlike setDelay() the system time is
+	not read, so the reply moment does not depend on how long the software took to get here.
+	If the time has already passed when startTransmit() is called, the transmission is aborted
+	and the late transmit handler is called.
+
+	@param[in] txTime The desired transmit timestamp at the antenna.
+
+	@return The actual transmit timestamp (DX_TIME resolution, antenna delay included).
+	*/
+	static DW1000Time   scheduleTxAt(const DW1000Time& txTime);
 	static void         receivePermanently(boolean val);
+	/** 
+	Sets the frame wait timeout of the receiver: a receive timeout event is raised if no frame was
+	received within this time after the receiver was enabled (with waitForResponse(), once the frame is
+	sent). It is written at once and applies from the next receiver enable.
+
+	@param[in] micros The wait time in microseconds (67 ms at most), 0 disables the timeout.
+	*/
+	static void         setReceiveFrameWaitTimeout(uint32_t micros);
+	/** 
+	Computes how long a frame stays on air with the current data rate, PRF and preamble length,
+	from the start of the preamble to the end of the CRC.
+
+	@param[in] length The data length, without the CRC.
+
+	@return The duration in microseconds, rounded up.
+	*/
+	static uint32_t     getFrameAirtime(uint16_t length);
+	// the same for the given mode (see `enableMode()`) instead of the current one
+	static uint32_t     getFrameAirtime(uint16_t length, const byte mode[]);
 	static void         setData(byte data[], uint16_t n);
 	static void         setData(const String& data);
 	static void         getData(byte data[], uint16_t n);
@@ -259,6 +323,32 @@ public:
 	static float getFirstPathPower();
 	static float getReceiveQuality();
 	
+	/** 
+	Reads RX_FINFO, RX_FQUAL and RX_TIME once and derives receive power, first path power,
+	quality and the corrected receive timestamp from that snapshot. Use this instead of the
+	single getters when more than one of these values is needed for the same frame.
+
+	@param[out] diag The snapshot of the last received frame.
+	*/
+	static void getRxDiagnostics(RxDiagnostics& diag);
+	
+	/** 
+	Latches the carrier integrator of every good frame while handling its interrupt, i.e. before the
+	receiver is enabled again and the value gets lost. It is reported by getRxDiagnostics() together
+	with the clock offset to the sender derived from it (single-sided ranging).
+	*/
+	static void captureCarrierIntegrator(boolean val) { _captureCarrierIntegrator = val; }
+	static float computeClockOffset(int32_t carrierIntegrator);
+	
+	/** 
+	Copies the interrupt event counters. There is a single writer (the task processing the
+	interrupts) and every counter is an aligned 32 bit word, so this is safe from any core
+	without locking; compare two copies to get rates.
+
+	@param[out] counters The current counter values.
+	*/
+	static void getEventCounters(EventCounters& counters);
+	
 	/* interrupt management. */
 	static void interruptOnSent(boolean val);
 	static void interruptOnReceived(boolean val);
@@ -270,6 +360,10 @@ public:
 	/* Antenna delay calibration */
 	static void setAntennaDelay(const uint16_t value);
 	static uint16_t getAntennaDelay();
+	/* Offset (ticks) added to the calibrated antenna delay, e.g. for its drift with temperature.
+	   getAntennaDelay() keeps returning the calibrated value. */
+	static void setAntennaDelayCompensation(int16_t ticks);
+	static int16_t getAntennaDelayCompensation() { return _antennaDelayCompensation; }
 
 	/* callback handler management. */
 	static void attachErrorHandler(void (* handleError)(void)) {
@@ -296,6 +390,10 @@ public:
 		_handleReceiveTimestampAvailable = handleReceiveTimestampAvailable;
 	}
 	
+	static void attachLateTransmitHandler(void (* handleLateTransmit)(void)) {
+		_handleLateTransmit = handleLateTransmit;
+	}
+	
 	/* device state management. */
 	// idle state
 	static void idle();
@@ -339,6 +437,15 @@ public:
 	@param[in] mode The mode of operation, encoded by the above defined constants.
 	*/
 	static void enableMode(const byte mode[]);
+
+	/**
+	Changes data rate, PRF and preamble length at runtime, keeping the rest of the configuration.
+	The preamble code follows the PRF and the chip is tuned again, which leaves it idle; settings
+	written outside the configuration (e.g. `high_power_init()`) have to be applied again.
+
+	@param[in] mode The mode of operation, as for `enableMode()`.
+	*/
+	static void switchMode(const byte mode[]);
 	
 	// use RX/TX specific and general default settings
 	static void setDefaults();
@@ -433,6 +540,7 @@ public:
 	static void (* _handleReceiveFailed)(void);
 	static void (* _handleReceiveTimeout)(void);
 	static void (* _handleReceiveTimestampAvailable)(void);
+	static void (* _handleLateTransmit)(void);
 	
 	/* register caches. */
 	static byte _syscfg[LEN_SYS_CFG];
@@ -460,6 +568,10 @@ public:
 	static byte       _pacSize;
 	static DW1000Time _antennaDelay;
 	static boolean    _antennaCalibrated;
+	static int16_t    _antennaDelayCompensation;
+	static boolean    _doubleBuffering;
+	static boolean    _captureCarrierIntegrator;
+	static int32_t    _carrierIntegrator;
 	
 	/* internal helper to remember how to properly act. */
 	static boolean _permanentReceive;
@@ -481,8 +593,17 @@ public:
 	/* Called from task/context (non-ISR) to process a pending IRQ. */
 	static void processPendingInterrupt();
 
+	/* Task woken by a direct-to-task notification on every IRQ, nullptr to only set the flag. */
+	static void notifyTaskOnInterrupt(TaskHandle_t task) { _irqTask = task; }
+
 	/* Set when an IRQ arrived and needs processing in task context. */
 	static volatile bool _irqPending;
+	static TaskHandle_t volatile _irqTask;
+	
+	/* Leaves the current state and enables the receiver again (permanent receive). */
+	static void restartReceive();
+	/* Resets the receiver after an overrun of both buffers. */
+	static void softResetReceiver();
 	
 	/* Allow MAC frame filtering . */
 	// TODO auto-acknowledge
@@ -496,8 +617,17 @@ public:
 	//Reserved is used for the Blink message
 	static void setFrameFilterAllowReserved(boolean val);
 	
-	// note: not sure if going to be implemented for now
+	/** 
+	Enables the second receive buffer (written to the chip with the system configuration). The receiver
+	then goes on into the other buffer while the host reads the frame in its own one. All RX registers
+	(RX_FINFO, RX_BUFFER, RX_FQUAL, RX_TIME and the RX status bits) show the host side buffer, so read
+	everything needed from a frame first and then call releaseReceiveBuffer().
+	*/
 	static void setDoubleBuffering(boolean val);
+	/* Hands the host side buffer back to the receiver, the next frame (if any) becomes readable. */
+	static void releaseReceiveBuffer();
+	/* Points the host side buffer to the one the receiver uses next, dropping a pending frame. */
+	static void syncReceiveBuffers();
 	// TODO is implemented, but needs testing
 	static void useExtendedFrameLength(boolean val);
 	// TODO is implemented, but needs testing
@@ -509,6 +639,8 @@ public:
 	/* device status flags */
 	static boolean isReceiveTimestampAvailable();
 	static boolean isTransmitDone();
+	static boolean isTransmitLate();
+	static boolean isReceiveOverrun();
 	static boolean isReceiveDone();
 	static boolean isReceiveFailed();
 	static boolean isReceiveTimeout();
@@ -542,6 +674,15 @@ public:
 	
 	/* timestamp correction. */
 	static void correctTimestamp(DW1000Time& timestamp);
+	static void correctTimestamp(DW1000Time& timestamp, float rxPower);
+	
+	/* receive power estimation from raw register values. */
+	static float computeReceivePower(uint16_t cirPower, uint16_t preambleCount);
+	static float computeFirstPathPower(uint16_t fpAmpl1, uint16_t fpAmpl2, uint16_t fpAmpl3, uint16_t preambleCount);
+	
+	/* fixed point helpers for the power estimation (see DW1000_FIXED_POINT_RX_POWER). */
+	static int32_t log2Q16(uint64_t value);
+	static float   powerFromLog2Q16(int32_t log2Value);
 	
 	/* reading and writing bytes from and to DW1000 module. */
 	static void readBytes(byte cmd, uint16_t offset, byte data[], uint16_t n);
@@ -564,6 +705,9 @@ public:
 	static const byte READ_SUB   = 0x40; // read with sub address
 	static const byte RW_SUB_EXT = 0x80; // R/W with sub address extension
 	
+	/* SPI bursts are staged in a word-aligned buffer of this size (ESP32 FIFO). */
+	static constexpr uint16_t SPI_BURST_LEN = 64;
+	
 	/* clocks available. */
 	static const byte AUTO_CLOCK = 0x00;
 	static const byte XTI_CLOCK  = 0x01;
@@ -586,6 +730,35 @@ public:
 	static constexpr byte BIAS_900_16[] = {137, 122, 105, 88, 69, 47, 25, 0, 21, 48, 79, 105, 127, 147, 160, 169, 178, 197};
 	static constexpr byte BIAS_900_64[] = {147, 133, 117, 99, 75, 50, 29, 0, 24, 45, 63, 76, 87, 98, 116, 122, 132, 142};
 	
+	/* range bias tables pre-expanded to signed timestamp corrections in Q8 [1/256 tick]. */
+	static const byte LEN_BIAS_TABLE = 18;
+	struct RangeBiasTable {
+		int16_t ticksQ8[LEN_BIAS_TABLE];
+	};
+	static const RangeBiasTable RANGE_BIAS_500_16;
+	static const RangeBiasTable RANGE_BIAS_500_64;
+	static const RangeBiasTable RANGE_BIAS_900_16;
+	static const RangeBiasTable RANGE_BIAS_900_64;
+	// table matching channel and PRF, selected in tune()
+	static const RangeBiasTable* _rangeBias;
+	
+	/* receive power constants of user manual section 4.7 in Q8 [dB] and Q12 (correction factor). */
+	static constexpr int32_t RX_POWER_A_16MHZ_Q8        = 29125; // 113.77
+	static constexpr int32_t RX_POWER_A_64MHZ_Q8        = 31165; // 121.74
+	static constexpr int32_t RX_POWER_CORR_16MHZ_Q12    = 9558;  // 2.3334
+	static constexpr int32_t RX_POWER_CORR_64MHZ_Q12    = 4779;  // 1.1667
+	// 10 * log10(2) * 2^8 / 2^16, scaled by 2^24
+	static constexpr int64_t LOG2_Q16_TO_DB_Q8          = 197283;
+	
+	/* carrier integrator to frequency offset [Hz] (user manual section 7.2.40.11), 110 kbps uses a longer integration. */
+	static constexpr float CARRINT_TO_HZ        = 998.4e6f / 2.0f / 1024.0f / 131072.0f;
+	static constexpr float CARRINT_TO_HZ_110KBPS = 998.4e6f / 2.0f / 8192.0f / 131072.0f;
+	
+	// log2(1 + i/32) in Q16, linearly interpolated in between
+	static constexpr uint32_t LOG2_TABLE[] = {0, 2909, 5732, 8473, 11136, 13727, 16248, 18704, 21098, 23433, 25711,
+		27936, 30109, 32234, 34312, 36346, 38336, 40286, 42196, 44068, 45904, 47705, 49472, 51207, 52911, 54584,
+		56229, 57845, 59434, 60997, 62534, 64047, 65536};
+	
 };
 
 extern DW1000Class DW1000;
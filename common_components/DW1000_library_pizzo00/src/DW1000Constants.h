@@ -64,6 +64,7 @@
 #define PHR_MODE_SUB 16
 #define LEN_PHR_MODE_SUB 2
 #define RXM110K_BIT 22
+#define RXWTOE_BIT 28
 
 // device control register
 #define SYS_CTRL 0x0D
@@ -75,6 +76,7 @@
 #define WAIT4RESP_BIT 7
 #define RXENAB_BIT 8
 #define RXDLYS_BIT 9
+#define HRBPT_BIT 24
 
 // system event status register
 #define SYS_STATUS 0x0F
@@ -92,11 +94,15 @@
 #define RXFCE_BIT 15
 #define RXRFSL_BIT 16
 #define RXRFTO_BIT 17
+#define RXOVRR_BIT 20
 #define RXPTO_BIT 21
 #define RXSFDTO_BIT 26
 #define LDEERR_BIT 18
 #define RFPLL_LL_BIT 24
 #define CLKPLL_LL_BIT 25
+#define HPDWARN_BIT 27
+#define HSRBP_BIT 30
+#define ICRBP_BIT 31
 
 // system event mask register
 // NOTE: uses the bit definitions of SYS_STATUS (below 32)
@@ -137,6 +143,10 @@
 #define DX_TIME 0x0A
 #define LEN_DX_TIME LEN_STAMP
 
+// receive frame wait timeout period
+#define RX_FWTO 0x0C
+#define LEN_RX_FWTO 2
+
 // transmit data buffer
 #define TX_BUFFER 0x09
 #define LEN_TX_BUFFER 1024
@@ -193,6 +203,8 @@
 #define DRX_TUNE1b_SUB 0x06
 #define DRX_TUNE2_SUB 0x08
 #define DRX_TUNE4H_SUB 0x26
+#define DRX_CARRINT_SUB 0x28
+#define LEN_DRX_CARRINT 3
 #define LEN_DRX_TUNE0b 2
 #define LEN_DRX_TUNE1a 2
 #define LEN_DRX_TUNE1b 2
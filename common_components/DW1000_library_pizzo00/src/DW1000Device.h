@@ -27,6 +27,9 @@
 
 #include "DW1000Time.h"
 
+// defined with the ranging protocol (DW1000Ranging.h)
+enum class MessageType : byte;
+
 class DW1000Device
 {
 public:
@@ -42,6 +45,8 @@ public:
 	void setRXPower(float power) { _RXPower = power; }
 	void setFPPower(float power) { _FPPower = power; }
 	void setQuality(float quality) { _quality = quality; }
+	void setRangeTimestamp(int64_t timestamp) { _rangeTimestamp = timestamp; }
+	void setImuTimestamp(int64_t timestamp) { _imuTimestamp = timestamp; }
 	void setReplyTime(uint16_t replyDelayTimeUs) { _replyDelayTimeUs = replyDelayTimeUs; }
 
 	// Getters
@@ -54,6 +59,10 @@ public:
 	float getRXPower() { return _RXPower; }
 	float getFPPower() { return _FPPower; }
 	float getQuality() { return _quality; }
+	// local time (DW1000Timebase, 64 bit ticks) of the frame which completed or delivered the range
+	int64_t getRangeTimestamp() { return _rangeTimestamp; }
+	// ANCHOR: local time (DW1000Timebase) of the IMU sample mpu_a* of the last POLL, 0 if unknown
+	int64_t getImuTimestamp() { return _imuTimestamp; }
 
 	boolean isAddressEqual(DW1000Device *device);
 	boolean isShortAddressEqual(DW1000Device *device);
@@ -68,6 +77,20 @@ public:
 	DW1000Time timeRangeReceived;
 
 	bool hasSentPoolAck;
+	// MAC sequence number of the POLL of the current exchange with this device (sent by the tag,
+	// answered by the anchor), carried by every frame of the exchange
+	uint8_t exchangeId = 0;
+	// PHY mode of the exchanges with this device after the POLL (0 = network mode, see useLinkAdaptation()):
+	// TAG chosen for this anchor, ANCHOR asked by this tag
+	uint8_t linkMode = 0;
+	// range not yet reported to the other side: single-sided on the tag, piggybacked on the anchor
+	bool hasPendingRange = false;
+	// TAG (Maestro pipeline): exchange state of this anchor, as the exchanges of two anchors overlap
+	bool awaitingPollAck = false;
+	bool awaitingRangeReport = false;
+	// ANCHOR: ranging session with this tag, each tag may be at a different step of its exchange
+	MessageType expectedMsgId = MessageType();
+	bool protocolFailed = false;
 
 	DW1000Time timePollAckReceivedMinusPollSent;
 	DW1000Time timeRangeSentMinusPollAckReceived;
@@ -90,6 +113,8 @@ private:
 	float _RXPower;
 	float _FPPower;
 	float _quality;
+	int64_t _rangeTimestamp = 0;
+	int64_t _imuTimestamp = 0;
 };
 
 #endif
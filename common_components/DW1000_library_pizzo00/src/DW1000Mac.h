@@ -67,6 +67,10 @@ public:
 	static void decodeBlinkFrame(byte frame[], byte shortAddress[]);
 	static void decodeShortMACFrame(byte frame[], byte address[]);
 	static void decodeLongMACFrame(byte frame[], byte address[]);
+
+	//sequence number of a short frame: the answers of an exchange echo the one of its POLL
+	static uint8_t decodeSequenceNumber(byte frame[]) { return frame[2]; }
+	static void setSequenceNumber(byte frame[], uint8_t seqNumber) { frame[2] = seqNumber; }
 	
 
 
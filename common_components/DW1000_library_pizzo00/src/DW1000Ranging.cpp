@@ -28,17 +28,41 @@
 #include "DW1000Ranging.h"
 #include "DW1000Device.h"
 #include "m_log.h"
+#include <esp_timer.h>
 
 DW1000RangingClass DW1000Ranging;
 
 int16_t DW1000RangingClass::_global_ax = 0;
 int16_t DW1000RangingClass::_global_ay = 0;
 int16_t DW1000RangingClass::_global_az = 0;
+int64_t DW1000RangingClass::_global_accelTime = 0;
+// setAccelData() runs in the task of the IMU, on the other core
+static portMUX_TYPE g_accelLock = portMUX_INITIALIZER_UNLOCKED;
 
 constexpr short rangeDeviceSize = 12;
-// 2 bytes (Endereço) + 2 bytes (ReplyTime) + 6 bytes (AX, AY, AZ) = 10 bytes
-constexpr short pollDeviceSize = 10;
+// 2 bytes (Endereço) + 2 bytes (ReplyTime) + 6 bytes (AX, AY, AZ) + 2 bytes (idade da amostra, us) = 12 bytes
+constexpr short pollDeviceSize = 12;
+// idade da amostra do IMU desconhecida ou acima de ~65 ms
+constexpr uint16_t imuAgeUnknown = 0xFFFF;
 constexpr uint8_t devicePerPollTransmit = 4;
+// single-sided POLL trailer: last range (float) and RX power (float) of the tag, NaN if none
+constexpr short singleSidedReportSize = 8;
+// range, RX power and quality (floats) of the previous exchange, carried by the anchor's next POLL_ACK,
+// then the age of that range in us at the POLL_ACK TX (uint32)
+constexpr short piggybackReportSize = 16;
+constexpr uint16_t pollAckMaxLength = SHORT_MAC_LEN + 1 + piggybackReportSize;
+
+// number of entries announced by a frame, limited to the ones it actually carries after its header
+static uint8_t entriesInFrame(uint8_t announced, uint16_t dataLength, uint16_t headerLength, short entrySize)
+{
+	uint16_t length = dataLength < LEN_DATA ? dataLength : LEN_DATA;
+	if (length < headerLength)
+	{
+		return 0;
+	}
+	uint16_t carried = (length - headerLength) / entrySize;
+	return announced < carried ? announced : carried;
+}
 
 #ifndef UWB_STRICT_MAC_DEST_FILTER
 #define UWB_STRICT_MAC_DEST_FILTER 1
@@ -54,6 +78,10 @@ constexpr uint8_t devicePerPollTransmit = 4;
  *  - Payload do POLL mantém compatibilidade com legado (lista contendo o endereço da âncora).
  *  - Âncora só responde se Dest Address do MAC header for o dela (software filter).
  *
+ * Rodada broadcast (useBroadcastRound):
+ *  - Um POLL broadcast lista até devicePerPollTransmit âncoras, cada uma com seu slot de resposta.
+ *  - Um RANGE broadcast leva os timestamps de todas as âncoras que responderam (mesma época).
+ *
  * Configurações ajustáveis:
  *  - Lista de âncoras (short address) em bytes: {LSB, MSB}.
  */
@@ -64,24 +92,24 @@ constexpr uint8_t devicePerPollTransmit = 4;
 #if UWB_MAESTRO_ENABLE
 static bool g_maestroEnabled = true;
 
-// >>> Ajuste aqui seus 4 short addresses (formato {LSB, MSB})
-static const byte g_maestroAnchorList[][2] = {
+// >>> Ajuste aqui seus 4 short addresses (formato {LSB, MSB}), ou useMaestroAnchors() antes do init()
+static byte g_maestroAnchorList[MAX_DEVICES][2] = {
     {0x40, 0x25},  // <--- Endereço da ÂNCORA (Target)
     {0x34, 0x37},  // <--- Zeros para não gerar lixo
     {0x50, 0x28},
     {0x14, 0x30},
 };
-static const uint8_t g_maestroAnchorCount = sizeof(g_maestroAnchorList) / sizeof(g_maestroAnchorList[0]);
-
-// Parâmetros (ms)
-// static const uint16_t g_maestroInterAnchorDelayMs = 0;   // delay fixo entre âncoras
-// static const uint16_t g_maestroPollTimeoutMs      = 5;   // timeout esperando POLL_ACK
-// static const uint16_t g_maestroRangeTimeoutMs     = 5;   // timeout esperando RANGE_REPORT
-// static const uint8_t  g_maestroMaxRetries         = 0;    // retries por âncora
-static const uint16_t g_maestroInterAnchorDelayMs = 2;
-static const uint16_t g_maestroPollTimeoutMs      = 15;
-static const uint16_t g_maestroRangeTimeoutMs     = 8;
-static const uint8_t  g_maestroMaxRetries         = 1;
+static uint8_t g_maestroAnchorCount = 4;
+
+// Parâmetros (us)
+// Os timeouts de resposta não são fixos: tempo de resposta da âncora + tempo no ar da resposta
+// (modo configurado) + margem, aplicados pelo timeout de RX do DW1000 (ver expectResponse()).
+static const uint16_t g_maestroInterAnchorDelayUs = 500;  // delay fixo entre âncoras
+static const uint16_t g_maestroTimeoutMarginUs    = 300;  // margem dos timeouts
+static const uint8_t  g_maestroMaxRetries         = 1;    // retries por âncora
+// Backoff (ms) de uma âncora que falha: base << (falhas seguidas - 1), até o máximo
+static const uint16_t g_maestroBackoffBaseMs      = 50;
+static const uint16_t g_maestroBackoffMaxMs       = 3200;
 
 // Estado interno
 enum MaestroStage : uint8_t {
@@ -93,11 +121,306 @@ enum MaestroStage : uint8_t {
 static MaestroStage g_maestroStage = MAESTRO_IDLE;
 static uint8_t  g_maestroAnchorIdx = 0;
 static uint8_t  g_maestroRetry = 0;
-static uint32_t g_maestroDeadlineMs = 0;
-static uint32_t g_maestroNextActionMs = 0;
+static uint32_t g_maestroDeadlineUs = 0;    // backstop por software do timeout de RX
+static uint32_t g_maestroNextActionUs = 0;
+static bool g_maestroBackingOff = false;    // todas as âncoras em backoff: espera a primeira
 static byte g_maestroCurrentAnchor[2] = {0x00, 0x00};
+// Rodada broadcast: todas as âncoras em um POLL e um RANGE
+static bool g_maestroBroadcastRound = false;
+static uint8_t g_maestroPendingReports = 0;
+// Pipeline: POLL da próxima âncora logo após o RANGE da atual (usePipelinedExchanges)
+static bool g_maestroPipelined = false;
+// Acorda a task do UWB ao fim do delay entre âncoras e dos deadlines (só com useTaskNotification)
+static esp_timer_handle_t g_maestroTimer = nullptr;
+
+static void maestroTimerCallback(void *task)
+{
+	xTaskNotifyGive((TaskHandle_t)task);
+}
+
+static void maestroWakeUpIn(uint32_t us)
+{
+	if (g_maestroTimer != nullptr)
+	{
+		esp_timer_stop(g_maestroTimer);
+		esp_timer_start_once(g_maestroTimer, us);
+	}
+}
+
+// Número de âncoras por rodada
+static uint8_t maestroRoundSize()
+{
+	if (!g_maestroBroadcastRound)
+	{
+		return 1;
+	}
+	return g_maestroAnchorCount < devicePerPollTransmit ? g_maestroAnchorCount : devicePerPollTransmit;
+}
+
+// Slot de resposta (POLL_ACK) da i-ésima âncora do POLL broadcast: um POLL_ACK no ar + margem entre slots
+static uint16_t maestroReplySlot(uint8_t i)
+{
+	return DEFAULT_REPLY_DELAY_TIME + i * (DW1000.getFrameAirtime(pollAckMaxLength) + g_maestroTimeoutMarginUs);
+}
+
+// Saúde de cada âncora da lista e crédito do round-robin ponderado
+static AnchorHealth g_maestroHealth[MAX_DEVICES];
+static int16_t g_maestroCredit[MAX_DEVICES];
+
+// o peso configurado (setAnchorWeight) sobrevive ao init()
+static void maestroInitHealth()
+{
+	for (uint8_t i = 0; i < g_maestroAnchorCount; i++)
+	{
+		uint8_t weight = g_maestroHealth[i].weight;
+		g_maestroHealth[i] = AnchorHealth();
+		g_maestroHealth[i].weight = weight;
+		g_maestroCredit[i] = 0;
+	}
+}
+
+static int8_t maestroAnchorIndex(const byte address[])
+{
+	for (uint8_t i = 0; i < g_maestroAnchorCount; i++)
+	{
+		if (memcmp(address, g_maestroAnchorList[i], 2) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void maestroRecordSuccess(const byte address[])
+{
+	int8_t i = maestroAnchorIndex(address);
+	if (i < 0)
+	{
+		return;
+	}
+	AnchorHealth &health = g_maestroHealth[i];
+	health.successRate += (255 - health.successRate) >> 3;
+	health.consecutiveFailures = 0;
+	health.retryAtMs = 0;
+	health.lastSuccessMs = millis();
+}
+
+static void maestroRecordFailure(const byte address[])
+{
+	int8_t i = maestroAnchorIndex(address);
+	if (i < 0)
+	{
+		return;
+	}
+	AnchorHealth &health = g_maestroHealth[i];
+	health.successRate -= health.successRate >> 3;
+	if (health.consecutiveFailures < 255)
+	{
+		health.consecutiveFailures++;
+	}
+	uint8_t shift = health.consecutiveFailures - 1;
+	uint32_t backoff = shift < 8 ? (uint32_t)g_maestroBackoffBaseMs << shift : g_maestroBackoffMaxMs;
+	health.retryAtMs = millis() + min(backoff, (uint32_t)g_maestroBackoffMaxMs);
+}
+
+// Próxima âncora: round-robin ponderado (suave) entre as que não estão em backoff; -1 se todas estiverem
+// (veja maestroFirstRetry())
+static int8_t maestroPickNextAnchor()
+{
+	uint32_t now = millis();
+	int16_t totalWeight = 0;
+	int8_t best = -1;
+	bool backingOff = false;
+	for (uint8_t i = 0; i < g_maestroAnchorCount; i++)
+	{
+		const AnchorHealth &health = g_maestroHealth[i];
+		if (health.weight == 0)
+		{
+			continue;
+		}
+		if (health.consecutiveFailures > 0 && (int32_t)(health.retryAtMs - now) > 0)
+		{
+			backingOff = true;
+			continue;
+		}
+		g_maestroCredit[i] += health.weight;
+		totalWeight += health.weight;
+		if (best < 0 || g_maestroCredit[i] > g_maestroCredit[best])
+		{
+			best = i;
+		}
+	}
+	if (best < 0)
+	{
+		// every weight 0: plain round-robin
+		return backingOff ? -1 : (g_maestroAnchorIdx + 1) % g_maestroAnchorCount;
+	}
+	g_maestroCredit[best] -= totalWeight;
+	return best;
+}
+
+// Âncora que sai do backoff primeiro, quando todas estão nele
+static uint8_t maestroFirstRetry()
+{
+	int8_t first = -1;
+	for (uint8_t i = 0; i < g_maestroAnchorCount; i++)
+	{
+		const AnchorHealth &health = g_maestroHealth[i];
+		if (health.weight != 0 && health.consecutiveFailures > 0 &&
+			(first < 0 || (int32_t)(health.retryAtMs - g_maestroHealth[first].retryAtMs) < 0))
+		{
+			first = i;
+		}
+	}
+	return first >= 0 ? first : 0;
+}
+
+/* Superframe TDMA (coordinateSuperframe / useSuperframe):
+ *  - A âncora coordenadora envia um BEACON broadcast por período: [seq][nSlots][slotUs(4)][guardUs(2)][donos(2 x nSlots)].
+ *  - Após o BEACON e o guard vem o slot 0, de entrada: tag sem slot envia JOIN em instante aleatório dele.
+ *  - O slot k (1..nSlots) do dono é uma rodada broadcast completa, com o POLL agendado no seu início.
+ *  - Slots de tags que não são mais ouvidas (INACTIVITY_TIME) voltam a ficar livres.
+ */
+static const uint8_t  g_superframeHeaderLength = SHORT_MAC_LEN + 9; // BEACON até a tabela de donos
+static const uint8_t  g_superframeMaxSlots = (LEN_DATA - g_superframeHeaderLength) / 2;
+static const uint16_t g_superframeBeaconTimeoutMs = 1000;  // sem BEACON a tag volta ao relógio próprio
+// Coordenadora
+static uint16_t g_superframePeriodMs = 0;       // 0 = desligado
+static uint8_t  g_superframeSlotCount = 0;
+static uint32_t g_superframeSlotLengthUs = 0; // modos lentos passam de 65 ms por rodada
+static uint16_t g_superframeGuardUs = 0;
+static uint8_t  g_superframeSeq = 0;
+static uint32_t g_superframeNextBeaconUs = 0;
+static byte     g_superframeSlots[g_superframeMaxSlots][2];  // dono de cada slot, {0, 0} = livre
+// Tag
+static bool     g_superframeTag = false;
+static uint32_t g_superframeLastBeaconMs = 0;
+static bool     g_superframeSlotPending = false; // POLL do nosso slot ainda não enviado
+static DW1000Time g_superframeSlotStart;         // início do nosso slot (relógio do DW1000)
+static uint32_t g_superframeSlotStartUs = 0;     // o mesmo em micros()
+static uint32_t g_superframeSlotEndUs = 0;
+
+// Duração de uma rodada broadcast completa (devicePerPollTransmit âncoras), timeouts inclusos
+static uint32_t superframeRoundLength()
+{
+	const uint8_t n = devicePerPollTransmit;
+	uint32_t length = DW1000.getFrameAirtime(SHORT_MAC_LEN + 2 + n * pollDeviceSize);
+	length += maestroReplySlot(n - 1) + DW1000.getFrameAirtime(pollAckMaxLength) + g_maestroTimeoutMarginUs;
+	length += DEFAULT_REPLY_DELAY_TIME + DW1000.getFrameAirtime(SHORT_MAC_LEN + 2 + n * rangeDeviceSize);
+	if (ENABLE_RANGE_REPORT)
+	{
+		length += (2 * (n - 1) + 1) * DEFAULT_REPLY_DELAY_TIME + DW1000.getFrameAirtime(SHORT_MAC_LEN + 9);
+	}
+	return length + g_maestroTimeoutMarginUs;
+}
+
+// Tag sincronizada: BEACON recebido há pouco
+static bool superframeActive()
+{
+	return g_superframeTag && g_superframeLastBeaconMs != 0 && millis() - g_superframeLastBeaconMs < g_superframeBeaconTimeoutMs;
+}
 #endif
 
+// microseconds from now until deadline, 0 if already reached (wrap safe)
+static uint32_t usUntil(uint32_t deadline, uint32_t now)
+{
+	int32_t remaining = (int32_t)(deadline - now);
+	return remaining > 0 ? remaining : 0;
+}
+
+// milliseconds from now until deadline, 0 if already reached (wrap safe)
+static uint32_t msUntil(uint32_t deadline, uint32_t now)
+{
+	int32_t remaining = (int32_t)(deadline - now);
+	return remaining > 0 ? remaining : 0;
+}
+
+/* TDOA clock model of a non-reference anchor, from the SYNCs of the reference:
+ * reference time = TX time of the last SYNC + (local time - its RX time) * (1 + skew) */
+static byte g_tdoaReference[2] = {0x00, 0x00};
+static int64_t g_tdoaSyncLocal = 0;   // RX time of the last SYNC (our clock)
+static int64_t g_tdoaSyncRef = 0;     // its TX time (reference clock)
+static float g_tdoaSkew = 0;          // reference ticks per local tick - 1
+static uint8_t g_tdoaSyncCount = 0;
+static uint32_t g_tdoaSyncMs = 0;
+static uint16_t g_tdoaSyncPeriodMs = 0; // announced by the reference
+
+// ticks from "from" to "to" on the 40 bit clock, negative if "to" is earlier
+static int64_t tdoaElapsed(int64_t to, int64_t from)
+{
+	int64_t elapsed = (to - from) & DW1000Time::TIME_MAX;
+	return elapsed > DW1000Time::TIME_MAX / 2 ? elapsed - DW1000Time::TIME_OVERFLOW : elapsed;
+}
+
+/* Link adaptation (useLinkAdaptation): PHY modes for the frames after the POLL, from the fastest to the
+ * most robust. The POLL carries the code of the exchange: row + 1, 0 = network mode. The PRF of every
+ * row is the one of the network mode (set in configureNetwork()): all frames of an exchange share it,
+ * and with it the range bias table and the antenna delay calibration. */
+static byte g_linkModes[][3] = {
+	{DW1000Class::TRX_RATE_6800KBPS, DW1000Class::TX_PULSE_FREQ_16MHZ, DW1000Class::TX_PREAMBLE_LEN_64},
+	{DW1000Class::TRX_RATE_6800KBPS, DW1000Class::TX_PULSE_FREQ_16MHZ, DW1000Class::TX_PREAMBLE_LEN_128},
+	{DW1000Class::TRX_RATE_850KBPS, DW1000Class::TX_PULSE_FREQ_16MHZ, DW1000Class::TX_PREAMBLE_LEN_256},
+	{DW1000Class::TRX_RATE_110KBPS, DW1000Class::TX_PULSE_FREQ_16MHZ, DW1000Class::TX_PREAMBLE_LEN_1024},
+};
+static const uint8_t g_linkModeCount = sizeof(g_linkModes) / sizeof(g_linkModes[0]);
+// antenna delay calibrated in each row, 0 = the one of the network mode
+static uint16_t g_linkModeAntennaDelay[g_linkModeCount] = {0};
+static uint16_t g_networkAntennaDelay = 0; // saved when leaving the network mode
+// RX power (dBm) each mode needs; a faster mode than the current one only with the hysteresis on top
+static const float g_linkModeMinPower[g_linkModeCount] = {-80.0f, -86.0f, -92.0f, -200.0f};
+static const float g_linkModeHysteresis = 3.0f;
+// first path this far below the RX power: non line of sight, one mode more robust
+static const float g_linkModeNlosGap = 6.0f;
+// reconfiguring the radio, added to the reply delays of a switched exchange
+static const uint16_t g_linkModeSwitchUs = 500;
+static byte g_networkMode[3];
+static bool g_highPower = false;
+static uint8_t g_linkModeActive = 0;   // mode the radio is in
+static uint8_t g_linkModePending = 0;  // TAG: mode of the answer to the POLL being sent
+static uint32_t g_linkModeUntilUs = 0; // ANCHOR: back to the network mode after the exchange
+
+static const byte *linkMode(uint8_t code)
+{
+	return code == 0 || code > g_linkModeCount ? g_networkMode : g_linkModes[code - 1];
+}
+
+/* code of a mode for the POLL, 0 (no switch, no extra delay) unless it is faster than the network mode:
+ * a far anchor has to hear the POLL in the network mode anyway, a more robust answer gains nothing */
+static uint8_t linkCode(uint8_t code)
+{
+	if (code == 0 || DW1000.getFrameAirtime(0, linkMode(code)) >= DW1000.getFrameAirtime(0, g_networkMode))
+	{
+		return 0;
+	}
+	return code;
+}
+
+// a reply in a link mode also needs the reconfiguration and its preamble on air before its timestamp
+static uint16_t linkReplyDelay(uint8_t code)
+{
+	if (code == 0)
+	{
+		return DEFAULT_REPLY_DELAY_TIME;
+	}
+	return DEFAULT_REPLY_DELAY_TIME + g_linkModeSwitchUs + DW1000.getFrameAirtime(0, linkMode(code));
+}
+
+// fastest mode the measured link allows
+static uint8_t linkModeFor(uint8_t current, float rxPower, float fpPower)
+{
+	uint8_t row = 0;
+	while (row < g_linkModeCount - 1 &&
+		   rxPower < g_linkModeMinPower[row] + (row + 1 < current ? g_linkModeHysteresis : 0))
+	{
+		row++;
+	}
+	if (rxPower - fpPower > g_linkModeNlosGap && row < g_linkModeCount - 1)
+	{
+		row++;
+	}
+	return row + 1;
+}
+
 constexpr uint8_t pollAckTimeSlots = 6;
 
 DW1000Device DW1000RangingClass::_networkDevices[MAX_DEVICES];
@@ -117,7 +440,10 @@ uint16_t DW1000RangingClass::_timerDelay;
 volatile uint8_t DW1000RangingClass::_networkDevicesNumber;
 volatile boolean DW1000RangingClass::_sentAck;
 volatile boolean DW1000RangingClass::_receivedAck;
-boolean DW1000RangingClass::_protocolFailed;
+volatile boolean DW1000RangingClass::_receiveTimeoutAck = false;
+uint32_t DW1000RangingClass::_replyDueUs = 0;
+uint32_t DW1000RangingClass::_rangeDueUs = 0;
+boolean DW1000RangingClass::_replyPending = false;
 uint32_t DW1000RangingClass::lastTimerTick;
 uint32_t DW1000RangingClass::_replyTimeOfLastPollAck;
 uint32_t DW1000RangingClass::_timeOfLastPollSent;
@@ -125,11 +451,26 @@ uint16_t DW1000RangingClass::_addressOfExpectedLastPollAck;
 int16_t DW1000RangingClass::counterForBlink;
 uint16_t DW1000RangingClass::_rangeInterval;
 uint32_t DW1000RangingClass::_rangingCountPeriod;
+boolean DW1000RangingClass::_taskNotification = false;
+boolean DW1000RangingClass::_doubleBuffering = false;
+boolean DW1000RangingClass::_singleSided = false;
+boolean DW1000RangingClass::_tdoa = false;
+uint16_t DW1000RangingClass::_tdoaSyncPeriod = 0;
+uint32_t DW1000RangingClass::_tdoaLastSync = 0;
+boolean DW1000RangingClass::_linkAdaptation = false;
+uint16_t DW1000RangingClass::_driftPeriod = 0;
+uint32_t DW1000RangingClass::_driftLastSample = 0;
+float DW1000RangingClass::_driftTicksPerDegree = 0;
+float DW1000RangingClass::_driftReferenceTemp = 0;
+float DW1000RangingClass::_temperature = NAN;
+float DW1000RangingClass::_voltage = NAN;
 void (*DW1000RangingClass::_handleNewRange)(DW1000Device *);
 void (*DW1000RangingClass::_handleBlinkDevice)(DW1000Device *);
 void (*DW1000RangingClass::_handleNewDevice)(DW1000Device *);
 void (*DW1000RangingClass::_handleInactiveDevice)(DW1000Device *);
 void (*DW1000RangingClass::_handleRemovedDeviceMaxReached)(DW1000Device *);
+void (*DW1000RangingClass::_handleLateTransmit)(DW1000Device *);
+void (*DW1000RangingClass::_handleTdoaSample)(const TdoaSample &);
 
 void DW1000RangingClass::init(BoardType type, uint16_t shortAddress, const char *wifiMacAddress, bool high_power, const byte mode[], uint8_t myRST, uint8_t mySS, uint8_t myIRQ)
 {
@@ -143,7 +484,6 @@ void DW1000RangingClass::init(BoardType type, const uint8_t *wifiMacAddress, uin
 	_networkDevicesNumber = 0;
 	_sentAck = false;
 	_receivedAck = false;
-	_protocolFailed = false;
 	lastTimerTick = 0;
 	_replyTimeOfLastPollAck = 0;
 	_addressOfExpectedLastPollAck = 0;
@@ -156,6 +496,8 @@ void DW1000RangingClass::init(BoardType type, const uint8_t *wifiMacAddress, uin
 	_handleNewDevice = 0;
 	_handleInactiveDevice = 0;
 	_handleRemovedDeviceMaxReached = 0;
+	_handleLateTransmit = 0;
+	_handleTdoaSample = 0;
 
 	initCommunication(myRST, mySS, myIRQ);
 
@@ -214,9 +556,14 @@ void DW1000RangingClass::init(BoardType type, const uint8_t *wifiMacAddress, uin
 
 		g_maestroAnchorIdx = 0;
 		g_maestroRetry = 0;
+		maestroInitHealth();
+		// a primeira âncora também consome seu crédito, senão ela é consultada duas vezes seguidas
+		int8_t first = maestroPickNextAnchor();
+		g_maestroAnchorIdx = first >= 0 ? first : 0;
+		g_maestroBackingOff = false;
 		g_maestroStage = MAESTRO_IDLE;
-		g_maestroNextActionMs = millis(); // inicia imediatamente
-		memcpy(g_maestroCurrentAnchor, g_maestroAnchorList[0], 2);
+		g_maestroNextActionUs = micros(); // inicia imediatamente
+		memcpy(g_maestroCurrentAnchor, g_maestroAnchorList[g_maestroAnchorIdx], 2);
 	}
 #endif
 }
@@ -237,6 +584,8 @@ void DW1000RangingClass::initCommunication(uint8_t myRST, uint8_t mySS, uint8_t
 
 	DW1000.begin(myIRQ, myRST);
 	DW1000.select(mySS);
+	// the system counter of the chip restarts with it
+	DW1000Timebase::reset();
 }
 
 void DW1000RangingClass::configureNetwork(uint16_t deviceAddress, uint16_t networkId, const byte mode[])
@@ -248,6 +597,19 @@ void DW1000RangingClass::configureNetwork(uint16_t deviceAddress, uint16_t netwo
 	DW1000.setNetworkId(networkId);
 	DW1000.enableMode(mode);
 	DW1000.commitConfiguration();
+	memcpy(g_networkMode, mode, sizeof(g_networkMode));
+	for (uint8_t i = 0; i < g_linkModeCount; i++)
+	{
+		g_linkModes[i][1] = mode[1];
+	}
+}
+
+void DW1000RangingClass::setLinkModeAntennaDelay(uint8_t code, uint16_t delay)
+{
+	if (code != 0 && code <= g_linkModeCount)
+	{
+		g_linkModeAntennaDelay[code - 1] = delay;
+	}
 }
 
 void DW1000RangingClass::generalStart(bool high_power)
@@ -255,6 +617,8 @@ void DW1000RangingClass::generalStart(bool high_power)
 	// attach callback for (successfully) sent and received messages
 	DW1000.attachSentHandler(handleSent);
 	DW1000.attachReceivedHandler(handleReceived);
+	DW1000.attachLateTransmitHandler(handleLateTransmit);
+	DW1000.attachReceiveTimeoutHandler(handleReceiveTimeout);
 	// anchor starts in receiving mode, awaiting a ranging poll message
 
 	/*
@@ -282,6 +646,7 @@ void DW1000RangingClass::generalStart(bool high_power)
 
 	if(high_power)
 		DW1000.high_power_init();
+	g_highPower = high_power;
 
 	// anchor starts in receiving mode, awaiting a ranging poll message
 	receiver();
@@ -372,7 +737,13 @@ DW1000Device *DW1000RangingClass::searchDistantDevice(byte shortAddress[])
 
 void DW1000RangingClass::checkForReset()
 {
-	uint32_t currentTime = millis();
+	// ANCHOR: the exchange in a link mode is over, listen to every tag again
+	if (_type == BoardType::ANCHOR && g_linkModeActive != 0 && !_sentAck && !_receivedAck &&
+		!isReplyPending() && usUntil(g_linkModeUntilUs, micros()) == 0)
+	{
+		switchLinkMode(0);
+		receiver();
+	}
 
 #if UWB_MAESTRO_ENABLE
 	// ===== TAG Maestro (round-robin) =====
@@ -381,60 +752,84 @@ void DW1000RangingClass::checkForReset()
 		// Não iniciar nova TX se há IRQ pendente de TX/RX
 		if (!_sentAck && !_receivedAck)
 		{
-			// Timeout esperando POLL_ACK
-			if (g_maestroStage == MAESTRO_WAIT_POLL_ACK && currentTime > g_maestroDeadlineMs)
+			uint32_t currentTimeUs = micros();
+			// Timeout de RX do DW1000 ou, se ele se perder, o deadline por software
+			boolean timedOut = _receiveTimeoutAck || usUntil(g_maestroDeadlineUs, currentTimeUs) == 0;
+			_receiveTimeoutAck = false;
+
+			// Timeout esperando POLL_ACK ou RANGE_REPORT
+			if ((g_maestroStage == MAESTRO_WAIT_POLL_ACK || g_maestroStage == MAESTRO_WAIT_RANGE_REPORT) && timedOut)
 			{
-				if (g_maestroRetry < g_maestroMaxRetries)
+				// a nova tentativa ou o RANGE armam o timeout de novo
+				DW1000.setReceiveFrameWaitTimeout(0);
+				DW1000Device *anchor = searchDistantDevice(g_maestroCurrentAnchor);
+				if (anchor != nullptr && anchor->linkMode != 0 && anchor->linkMode < g_linkModeCount)
 				{
-					g_maestroRetry++;
-					_expectedMsgId = MessageType::POLL_ACK;
-					memcpy(g_maestroCurrentAnchor, g_maestroAnchorList[g_maestroAnchorIdx], 2);
-					transmitPoll();
-					g_maestroDeadlineMs = currentTime + g_maestroPollTimeoutMs;
+					// the exchange got lost in this link mode, the next one in a more robust
+					anchor->linkMode++;
 				}
-				else
+				boolean anyPollAck = false;
+				for (uint8_t i = 0; i < _networkDevicesNumber; i++)
 				{
-					g_maestroRetry = 0;
-					g_maestroAnchorIdx = (g_maestroAnchorIdx + 1) % g_maestroAnchorCount;
-					g_maestroStage = MAESTRO_INTER_DELAY;
-					g_maestroNextActionMs = currentTime + g_maestroInterAnchorDelayMs;
+					anyPollAck |= _networkDevices[i].hasSentPoolAck;
 				}
-			}
-			// Timeout esperando RANGE_REPORT
-			else if (g_maestroStage == MAESTRO_WAIT_RANGE_REPORT && currentTime > g_maestroDeadlineMs)
-			{
-				if (g_maestroRetry < g_maestroMaxRetries)
+
+				if (g_maestroBroadcastRound && g_maestroStage == MAESTRO_WAIT_POLL_ACK && anyPollAck)
 				{
+					// Fim dos slots: RANGE com as âncoras que responderam
+					transmitRange();
+				}
+				else if (g_maestroBroadcastRound && g_maestroStage == MAESTRO_WAIT_RANGE_REPORT)
+				{
+					// O RANGE já saiu, as âncoras têm suas distâncias: próxima rodada
+					advanceToNextAnchor();
+				}
+				else if (g_maestroRetry < g_maestroMaxRetries &&
+						 (!superframeActive() || usUntil(g_superframeSlotEndUs, currentTimeUs) >= superframeRoundLength()))
+				{
+					// em superframe, só se a nova tentativa ainda cabe no slot
 					g_maestroRetry++;
-					_expectedMsgId = MessageType::POLL_ACK;
-					memcpy(g_maestroCurrentAnchor, g_maestroAnchorList[g_maestroAnchorIdx], 2);
-					transmitPoll();
-					g_maestroStage = MAESTRO_WAIT_POLL_ACK;
-					g_maestroDeadlineMs = currentTime + g_maestroPollTimeoutMs;
+					pollCurrentAnchor();
 				}
 				else
 				{
-					g_maestroRetry = 0;
-					g_maestroAnchorIdx = (g_maestroAnchorIdx + 1) % g_maestroAnchorCount;
-					g_maestroStage = MAESTRO_INTER_DELAY;
-					g_maestroNextActionMs = currentTime + g_maestroInterAnchorDelayMs;
+					// a âncora não completou a troca: backoff
+					maestroRecordFailure(g_maestroCurrentAnchor);
+					advanceToNextAnchor();
 				}
 			}
-			// Inicia POLL para a âncora atual (IDLE/INTER_DELAY)
+			// Inicia POLL para a âncora atual (IDLE/INTER_DELAY); em superframe, uma vez por slot recebido
 			else if ((g_maestroStage == MAESTRO_IDLE || g_maestroStage == MAESTRO_INTER_DELAY) &&
-					 currentTime >= g_maestroNextActionMs)
+					 (superframeActive() ? g_superframeSlotPending : usUntil(g_maestroNextActionUs, currentTimeUs) == 0))
 			{
 				g_maestroRetry = 0;
-				_expectedMsgId = MessageType::POLL_ACK;
-				memcpy(g_maestroCurrentAnchor, g_maestroAnchorList[g_maestroAnchorIdx], 2);
-				transmitPoll();
-				g_maestroStage = MAESTRO_WAIT_POLL_ACK;
-				g_maestroDeadlineMs = currentTime + g_maestroPollTimeoutMs;
+				pollCurrentAnchor();
 			}
 		}
 	}
+
+	// ===== ANCHOR coordenadora do superframe =====
+	// o BEACON não pode cancelar uma resposta já agendada, sai logo depois dela
+	if (_type == BoardType::ANCHOR && g_superframePeriodMs != 0 && !_sentAck && !_receivedAck &&
+		!isReplyPending() && g_linkModeActive == 0 && usUntil(g_superframeNextBeaconUs, micros()) == 0)
+	{
+		transmitBeacon();
+	}
 #endif
 
+	// TDOA reference anchor: SYNC once per period, without cancelling a scheduled reply
+	if (_type == BoardType::ANCHOR && _tdoaSyncPeriod != 0 && !_sentAck && !_receivedAck &&
+		!isReplyPending() && g_linkModeActive == 0 && millis() - _tdoaLastSync >= _tdoaSyncPeriod)
+	{
+		transmitTdoaSync();
+	}
+
+	// temperature/voltage between exchanges (the SAR is started through the RF registers)
+	if (_driftPeriod != 0 && millis() - _driftLastSample >= _driftPeriod && isIdle())
+	{
+		sampleTempAndVbat();
+	}
+
 	if (!_sentAck && !_receivedAck)
 	{
 		resetInactive();
@@ -442,6 +837,366 @@ void DW1000RangingClass::checkForReset()
 	}
 }
 
+#if UWB_MAESTRO_ENABLE
+void DW1000RangingClass::pollCurrentAnchor()
+{
+	_expectedMsgId = MessageType::POLL_ACK;
+	memcpy(g_maestroCurrentAnchor, g_maestroAnchorList[g_maestroAnchorIdx], 2);
+	// every POLL goes out in the network mode
+	if (g_linkModeActive != 0)
+	{
+		switchLinkMode(0);
+	}
+	g_linkModePending = 0;
+	transmitPoll();
+	g_maestroStage = MAESTRO_WAIT_POLL_ACK;
+}
+
+void DW1000RangingClass::advanceToNextAnchor()
+{
+	g_maestroRetry = 0;
+	if (g_maestroBroadcastRound)
+	{
+		// failing anchors only cost their reply slot here
+		g_maestroAnchorIdx = (g_maestroAnchorIdx + maestroRoundSize()) % g_maestroAnchorCount;
+	}
+	else
+	{
+		int8_t next = maestroPickNextAnchor();
+		g_maestroBackingOff = next < 0;
+		g_maestroAnchorIdx = next >= 0 ? next : maestroFirstRetry();
+	}
+	// the exchange is over, the receiver must not give up on frames of other devices
+	DW1000.setReceiveFrameWaitTimeout(0);
+	uint32_t delayUs = g_maestroInterAnchorDelayUs;
+	if (g_maestroBackingOff)
+	{
+		// every anchor backs off: nothing to POLL before the first one is due
+		uint32_t retryUs = msUntil(g_maestroHealth[g_maestroAnchorIdx].retryAtMs, millis()) * 1000UL;
+		delayUs = max(delayUs, retryUs);
+	}
+	g_maestroStage = MAESTRO_INTER_DELAY;
+	g_maestroNextActionUs = micros() + delayUs;
+	maestroWakeUpIn(delayUs);
+}
+
+void DW1000RangingClass::expectResponse(uint32_t txDelay, uint16_t sentLength, uint16_t replyDelay, uint16_t responseLength, const byte responseMode[])
+{
+	// receiver on as soon as our frame is out, it gives up when the answer can't come anymore
+	uint32_t responseAirtime = responseMode != nullptr ? DW1000.getFrameAirtime(responseLength, responseMode) : DW1000.getFrameAirtime(responseLength);
+	uint32_t rxTimeout = replyDelay + responseAirtime + g_maestroTimeoutMarginUs;
+	DW1000.setReceiveFrameWaitTimeout(rxTimeout);
+	DW1000.waitForResponse(true);
+	_receiveTimeoutAck = false;
+	uint32_t deadline = txDelay + DW1000.getFrameAirtime(sentLength) + rxTimeout + g_maestroTimeoutMarginUs;
+	g_maestroDeadlineUs = micros() + deadline;
+	// the frame wait timeout restarts with every frame received, this one does not
+	maestroWakeUpIn(deadline);
+}
+
+void DW1000RangingClass::handleBeacon(byte coordinator[], const RxDiagnostics &rxDiag)
+{
+	if (rxDiag.dataLength < g_superframeHeaderLength)
+	{
+		return;
+	}
+	g_superframeLastBeaconMs = millis();
+	uint8_t slotCount = entriesInFrame(min(receivedData[SHORT_MAC_LEN + 2], g_superframeMaxSlots), rxDiag.dataLength,
+									   g_superframeHeaderLength, 2);
+	uint32_t slotLengthUs;
+	uint16_t guardUs;
+	memcpy(&slotLengthUs, receivedData + SHORT_MAC_LEN + 3, 4);
+	memcpy(&guardUs, receivedData + SHORT_MAC_LEN + 7, 2);
+
+	// the slots count from the RX timestamp of the BEACON, our processing latency does not matter
+	for (uint8_t i = 0; i < slotCount; i++)
+	{
+		if (memcmp(receivedData + g_superframeHeaderLength + 2 * i, _ownShortAddress, 2) == 0)
+		{
+			// slot 0 of the superframe is the join slot
+			uint32_t offsetUs = guardUs + (i + 1) * slotLengthUs;
+			g_superframeSlotStart = rxDiag.timestamp + DW1000Duration::fromMicroseconds(offsetUs);
+			g_superframeSlotStartUs = micros() + offsetUs;
+			g_superframeSlotEndUs = g_superframeSlotStartUs + slotLengthUs;
+			g_superframeSlotPending = true;
+			return;
+		}
+	}
+
+	// no slot yet: ask for one at a random moment of the join slot, unless an exchange is running
+	g_superframeSlotPending = false;
+	if (g_maestroStage == MAESTRO_WAIT_POLL_ACK || g_maestroStage == MAESTRO_WAIT_RANGE_REPORT)
+	{
+		return;
+	}
+	uint16_t joinAirtime = DW1000.getFrameAirtime(SHORT_MAC_LEN + 1);
+	uint32_t offsetUs = guardUs + (slotLengthUs > joinAirtime ? random(0, slotLengthUs - joinAirtime) : 0);
+	transmitJoin(coordinator, rxDiag.timestamp + DW1000Duration::fromMicroseconds(offsetUs));
+}
+
+void DW1000RangingClass::transmitJoin(byte coordinator[], DW1000Time time)
+{
+	transmitInit();
+	_globalMac.generateShortMACFrame(sentData, _ownShortAddress, coordinator);
+	sentData[SHORT_MAC_LEN] = static_cast<byte>(MessageType::JOIN);
+	copyShortAddress(_lastSentToShortAddress, coordinator);
+	DW1000.scheduleTxAt(time);
+	transmit(sentData, SHORT_MAC_LEN + 1);
+}
+#endif
+
+void DW1000RangingClass::coordinateSuperframe(uint16_t periodMs)
+{
+#if UWB_MAESTRO_ENABLE
+	g_superframePeriodMs = periodMs;
+	if (periodMs == 0)
+	{
+		return;
+	}
+	// a slot holds one whole broadcast round of the configured mode, the guard the longest BEACON
+	g_superframeSlotLengthUs = superframeRoundLength();
+	g_superframeGuardUs = DW1000.getFrameAirtime(g_superframeHeaderLength + 2 * g_superframeMaxSlots) + DEFAULT_REPLY_DELAY_TIME;
+	uint32_t periodUs = periodMs * 1000UL;
+	uint32_t slots = periodUs > g_superframeGuardUs ? (periodUs - g_superframeGuardUs) / g_superframeSlotLengthUs : 0;
+	// the first one is the join slot
+	g_superframeSlotCount = slots > 1 ? min(slots - 1, (uint32_t)g_superframeMaxSlots) : 0;
+	memset(g_superframeSlots, 0, sizeof(g_superframeSlots));
+	g_superframeNextBeaconUs = micros();
+	if (g_superframeSlotCount == 0)
+	{
+		m_log::log_err(LOG_DW1000, "Superframe: a period of %u ms holds no slot of %lu us", periodMs,
+					   (unsigned long)g_superframeSlotLengthUs);
+		g_superframePeriodMs = 0;
+		return;
+	}
+	m_log::log_inf(LOG_DW1000, "Superframe: %u slots of %lu us", g_superframeSlotCount, (unsigned long)g_superframeSlotLengthUs);
+#endif
+}
+
+void DW1000RangingClass::useSuperframe(boolean val)
+{
+#if UWB_MAESTRO_ENABLE
+	g_superframeTag = val;
+	g_superframeSlotPending = false;
+	if (val)
+	{
+		// a slot is sized for one broadcast round
+		g_maestroBroadcastRound = true;
+	}
+#endif
+}
+
+void DW1000RangingClass::useBroadcastRound(boolean val)
+{
+#if UWB_MAESTRO_ENABLE
+	g_maestroBroadcastRound = val;
+#endif
+}
+
+void DW1000RangingClass::usePipelinedExchanges(boolean val)
+{
+#if UWB_MAESTRO_ENABLE
+	g_maestroPipelined = val;
+#endif
+}
+
+void DW1000RangingClass::useMaestroAnchors(const uint16_t shortAddresses[], uint8_t count)
+{
+#if UWB_MAESTRO_ENABLE
+	if (count == 0)
+	{
+		// sem âncoras o round-robin não tem para onde ir: mantém a lista atual
+		return;
+	}
+	// a lista é carregada como dispositivos no init()
+	g_maestroAnchorCount = min(count, (uint8_t)MAX_DEVICES);
+	for (uint8_t i = 0; i < g_maestroAnchorCount; i++)
+	{
+		DW1000.convertToByte(shortAddresses[i], g_maestroAnchorList[i]);
+		// outra lista, outros índices: os pesos recomeçam
+		g_maestroHealth[i] = AnchorHealth();
+	}
+#endif
+}
+
+boolean DW1000RangingClass::getAnchorHealth(uint8_t index, AnchorHealth &health)
+{
+#if UWB_MAESTRO_ENABLE
+	if (index < g_maestroAnchorCount)
+	{
+		health = g_maestroHealth[index];
+		return true;
+	}
+#endif
+	return false;
+}
+
+void DW1000RangingClass::setAnchorWeight(uint8_t index, uint8_t weight)
+{
+#if UWB_MAESTRO_ENABLE
+	if (index < g_maestroAnchorCount)
+	{
+		g_maestroHealth[index].weight = weight;
+	}
+#endif
+}
+
+uint32_t DW1000RangingClass::getTimeToNextDeadline()
+{
+	if (_sentAck || _receivedAck)
+	{
+		return 0;
+	}
+	// every check in loop() fires once its time difference is strictly greater, hence the + 1
+	uint32_t currentTime = millis();
+	uint32_t wait = msUntil(lastTimerTick + _timerDelay + 1, currentTime);
+	wait = min(wait, msUntil(_lastActivity + _resetPeriod + 1, currentTime));
+#if UWB_MAESTRO_ENABLE
+	if (_type == BoardType::TAG && g_maestroEnabled)
+	{
+		// the RX timeout IRQ and the inter-anchor timer normally come first, rounded up to whole ms
+		uint32_t currentTimeUs = micros();
+		uint32_t waitUs;
+		if (g_maestroStage == MAESTRO_WAIT_POLL_ACK || g_maestroStage == MAESTRO_WAIT_RANGE_REPORT)
+		{
+			waitUs = usUntil(g_maestroDeadlineUs, currentTimeUs);
+		}
+		else if (superframeActive() && !g_superframeSlotPending)
+		{
+			// the next BEACON comes with an IRQ, only its absence is a deadline
+			return min(wait, msUntil(g_superframeLastBeaconMs + g_superframeBeaconTimeoutMs, currentTime));
+		}
+		else
+		{
+			waitUs = usUntil(g_maestroNextActionUs, currentTimeUs);
+		}
+		return min(wait, (waitUs + 999) / 1000);
+	}
+	if (_type == BoardType::ANCHOR && g_superframePeriodMs != 0)
+	{
+		wait = min(wait, (usUntil(g_superframeNextBeaconUs, micros()) + 999) / 1000);
+	}
+#endif
+	if (_type == BoardType::ANCHOR && _tdoaSyncPeriod != 0)
+	{
+		wait = min(wait, msUntil(_tdoaLastSync + _tdoaSyncPeriod, currentTime));
+	}
+	if (_driftPeriod != 0)
+	{
+		wait = min(wait, msUntil(_driftLastSample + _driftPeriod, currentTime));
+	}
+	if (_type == BoardType::ANCHOR && g_linkModeActive != 0)
+	{
+		wait = min(wait, (usUntil(g_linkModeUntilUs, micros()) + 999) / 1000);
+	}
+	if (_replyTimeOfLastPollAck != 0)
+	{
+		wait = min(wait, msUntil(_timeOfLastPollSent + _replyTimeOfLastPollAck + 4, currentTime));
+	}
+	return wait;
+}
+
+void DW1000RangingClass::useSingleSidedRanging(boolean val)
+{
+	_singleSided = val;
+	// the clock offset comes from the carrier integrator of the POLL_ACK
+	DW1000.captureCarrierIntegrator(val);
+}
+
+void DW1000RangingClass::useTdoaBlinks(boolean val)
+{
+#if UWB_MAESTRO_ENABLE
+	// Maestro state of the application, given back when the BLINKs stop
+	static bool maestroBeforeTdoa = false;
+	if (_type == BoardType::TAG && val != _tdoa)
+	{
+		// the BLINKs replace the Maestro rounds
+		if (val)
+		{
+			maestroBeforeTdoa = g_maestroEnabled;
+			g_maestroEnabled = false;
+		}
+		else
+		{
+			g_maestroEnabled = maestroBeforeTdoa;
+		}
+	}
+#endif
+	_tdoa = val;
+}
+
+void DW1000RangingClass::useTdoaReference(uint16_t syncPeriodMs)
+{
+	_tdoaSyncPeriod = syncPeriodMs;
+	if (syncPeriodMs != 0)
+	{
+		_tdoa = true;
+		_tdoaLastSync = millis() - syncPeriodMs;
+	}
+}
+
+void DW1000RangingClass::useDriftCompensation(uint16_t periodMs, float ticksPerDegree, float referenceTemp)
+{
+	_driftPeriod = periodMs;
+	_driftTicksPerDegree = ticksPerDegree;
+	_driftReferenceTemp = referenceTemp;
+	_driftLastSample = millis() - periodMs;
+	if (periodMs == 0)
+	{
+		DW1000.setAntennaDelayCompensation(0);
+	}
+}
+
+void DW1000RangingClass::sampleTempAndVbat()
+{
+	_driftLastSample = millis();
+	float temperature;
+	float voltage;
+	DW1000.getTempAndVbat(temperature, voltage);
+	if (isnan(_temperature))
+	{
+		_temperature = temperature;
+		_voltage = voltage;
+	}
+	else
+	{
+		// one LSB of the SAR is 1.14 degrees C, smooth it out
+		_temperature += (temperature - _temperature) / 8;
+		_voltage += (voltage - _voltage) / 8;
+	}
+	// warmer antenna path, longer delay: the range would grow with the temperature
+	DW1000.setAntennaDelayCompensation((int16_t)lroundf(_driftTicksPerDegree * (_temperature - _driftReferenceTemp)));
+}
+
+void DW1000RangingClass::useTaskNotification(TaskHandle_t task)
+{
+	_taskNotification = (task != nullptr);
+	DW1000.notifyTaskOnInterrupt(task);
+#if UWB_MAESTRO_ENABLE
+	if (task != nullptr && g_maestroTimer == nullptr)
+	{
+		esp_timer_create_args_t timerArgs = {};
+		timerArgs.callback = &maestroTimerCallback;
+		timerArgs.arg = task;
+		timerArgs.dispatch_method = ESP_TIMER_TASK;
+		timerArgs.name = "uwb_maestro";
+		esp_timer_create(&timerArgs, &g_maestroTimer);
+	}
+#endif
+}
+
+void DW1000RangingClass::waitForEvent()
+{
+	if (!_taskNotification)
+	{
+		// polling mode
+		vTaskDelay(pdMS_TO_TICKS(1));
+		return;
+	}
+	// an IRQ that arrived while loop() was running is still counted, so this returns at once
+	ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(getTimeToNextDeadline()));
+}
+
 void DW1000RangingClass::checkForInactiveDevices()
 {
 	uint8_t inactiveDevicesNum = 0;
@@ -487,10 +1242,31 @@ MessageType DW1000RangingClass::detectMessageType(byte datas[])
 uint32_t DEBUGtimePollSent;
 uint32_t DEBUGRangeSent;
 
-void DW1000RangingClass::setAccelData(int16_t ax, int16_t ay, int16_t az) {
+void DW1000RangingClass::setAccelData(int16_t ax, int16_t ay, int16_t az, int64_t sampleTime) {
+    portENTER_CRITICAL(&g_accelLock);
     _global_ax = ax;
     _global_ay = ay;
     _global_az = az;
+    _global_accelTime = sampleTime;
+    portEXIT_CRITICAL(&g_accelLock);
+}
+
+// [AX(2)][AY(2)][AZ(2)][idade(2)] de uma entrada do POLL, idade em us até pollTime (DW1000Timebase)
+void DW1000RangingClass::writePollImu(byte data[], int64_t pollTime)
+{
+	portENTER_CRITICAL(&g_accelLock);
+	int16_t imu[3] = {_global_ax, _global_ay, _global_az};
+	int64_t sampleTime = _global_accelTime;
+	portEXIT_CRITICAL(&g_accelLock);
+
+	uint16_t age = imuAgeUnknown;
+	if (sampleTime != 0 && pollTime != 0)
+	{
+		int64_t ageUs = DW1000Timebase::toMicroseconds(pollTime - sampleTime);
+		age = ageUs < 0 ? 0 : ageUs < imuAgeUnknown ? (uint16_t)ageUs : imuAgeUnknown;
+	}
+	memcpy(data, imu, 6);
+	memcpy(data + 6, &age, 2);
 }
 
 void DW1000RangingClass::loop()
@@ -498,6 +1274,9 @@ void DW1000RangingClass::loop()
 	// First process any pending IRQs deferred from ISR context
 	DW1000.processPendingInterrupt();
 
+	// follow the rollovers of the 40 bit system counter (rate limited, one SPI read per period)
+	DW1000Timebase::update();
+
 	// we check if needed to reset!
 	checkForReset();
 	uint32_t currentTime = millis();
@@ -543,6 +1322,15 @@ void DW1000RangingClass::loop()
 		case MessageType::RANGING_INIT:
 			//m_log::log_dbg(LOG_DW1000_MSG, "RANGING_INIT");
 			break;
+		case MessageType::BEACON:
+			//m_log::log_dbg(LOG_DW1000_MSG, "BEACON");
+			break;
+		case MessageType::JOIN:
+			//m_log::log_dbg(LOG_DW1000_MSG, "JOIN");
+			break;
+		case MessageType::SYNC:
+			//m_log::log_dbg(LOG_DW1000_MSG, "SYNC");
+			break;
 		case MessageType::TYPE_ERROR:
 			//m_log::log_dbg(LOG_DW1000_MSG, "TYPE_ERROR");
 			break;
@@ -583,6 +1371,23 @@ void DW1000RangingClass::loop()
 					_networkDevices[i].timePollSent = timePollSent;
 					_networkDevices[i].hasSentPoolAck = false;
 				}
+				// a new exchange with the polled anchors only, the others may still be in theirs
+				uint8_t exchangeId = DW1000Mac::decodeSequenceNumber(sentData);
+				uint8_t numberDevices = sentData[SHORT_MAC_LEN + 1];
+				for (uint8_t i = 0; i < numberDevices; i++)
+				{
+					DW1000Device *anchor = searchDistantDevice(sentData + SHORT_MAC_LEN + 2 + i * pollDeviceSize);
+					if (anchor != nullptr)
+					{
+						anchor->exchangeId = exchangeId;
+					}
+				}
+				if (g_linkModePending != g_linkModeActive)
+				{
+					// the answer comes in the link mode of the polled anchor (the frame wait timeout is kept)
+					switchLinkMode(g_linkModePending);
+					receiver();
+				}
 			}
 			else if (messageType == MessageType::RANGE)
 			{
@@ -593,6 +1398,33 @@ void DW1000RangingClass::loop()
 				{
 					_networkDevices[i].timeRangeSent = timeRangeSent;
 				}
+#if UWB_MAESTRO_ENABLE
+				if (g_maestroEnabled && !ENABLE_RANGE_REPORT)
+				{
+					// no report to wait for, the exchange ends here
+					advanceToNextAnchor();
+					if (g_maestroPipelined && !g_maestroBroadcastRound && !g_maestroBackingOff)
+					{
+						// the anchor computes its range on its own: POLL the next one right away
+						g_maestroRetry = 0;
+						pollCurrentAnchor();
+					}
+				}
+				else if (g_maestroEnabled && g_maestroPipelined && !g_maestroBroadcastRound)
+				{
+					// the report comes DEFAULT_REPLY_DELAY_TIME after the RANGE: POLL the next anchor meanwhile
+					// if that POLL is out before, otherwise wait for the report as usual
+					uint32_t pollAirtime = DW1000.getFrameAirtime(SHORT_MAC_LEN + 2 + pollDeviceSize);
+					if (pollAirtime + DW1000.getFrameAirtime(SHORT_MAC_LEN + 9) + g_maestroTimeoutMarginUs <= DEFAULT_REPLY_DELAY_TIME)
+					{
+						advanceToNextAnchor();
+						if (!g_maestroBackingOff)
+						{
+							pollCurrentAnchor();
+						}
+					}
+				}
+#endif
 			}
 		}
 	}
@@ -602,9 +1434,15 @@ void DW1000RangingClass::loop()
 	{
 		_receivedAck = false;
 
+		// one batched read serves the frame length and every power/quality/timestamp consumer below
+		RxDiagnostics rxDiag;
+		DW1000.getRxDiagnostics(rxDiag);
+
 		// we read the datas from the modules:
-		//  get message and parse
-		DW1000.getData(receivedData, LEN_DATA);
+		//  get message and parse, only the bytes actually received
+		DW1000.getData(receivedData, rxDiag.dataLength < LEN_DATA ? rxDiag.dataLength : LEN_DATA);
+		// everything of this frame is copied, with double buffering the next one may come in
+		DW1000.releaseReceiveBuffer();
 
 		MessageType messageType = detectMessageType(receivedData);
 
@@ -628,6 +1466,15 @@ void DW1000RangingClass::loop()
 		case MessageType::RANGING_INIT:
 			//m_log::log_dbg(LOG_DW1000_MSG, "<=RANGING_INIT");
 			break;
+		case MessageType::BEACON:
+			//m_log::log_dbg(LOG_DW1000_MSG, "<=BEACON");
+			break;
+		case MessageType::JOIN:
+			//m_log::log_dbg(LOG_DW1000_MSG, "<=JOIN");
+			break;
+		case MessageType::SYNC:
+			//m_log::log_dbg(LOG_DW1000_MSG, "<=SYNC");
+			break;
 		case MessageType::TYPE_ERROR:
 			//m_log::log_dbg(LOG_DW1000_MSG, "<=TYPE_ERROR");
 			break;
@@ -636,15 +1483,30 @@ void DW1000RangingClass::loop()
 			break;
 		};
 
+		if (messageType == MessageType::BLINK && _type == BoardType::ANCHOR && _tdoa)
+		{
+			handleTdoaBlink(rxDiag);
+			noteActivity();
+		}
+		else if (messageType == MessageType::SYNC)
+		{
+			byte address[2];
+			_globalMac.decodeShortMACFrame(receivedData, address);
+			if (_type == BoardType::ANCHOR && _tdoa && _tdoaSyncPeriod == 0)
+			{
+				handleTdoaSync(address, rxDiag);
+				noteActivity();
+			}
+		}
 		// we have just received a BLINK message from tag
-		if (messageType == MessageType::BLINK && _type == BoardType::ANCHOR)
+		else if (messageType == MessageType::BLINK && _type == BoardType::ANCHOR)
 		{
 			byte shortAddress[2];
 			_globalMac.decodeBlinkFrame(receivedData, shortAddress);
 
 			bool knownByTheTag = false;
 
-			uint8_t numberDevices = receivedData[BLINK_MAC_LEN];
+			uint8_t numberDevices = entriesInFrame(receivedData[BLINK_MAC_LEN], rxDiag.dataLength, BLINK_MAC_LEN + 1, 2);
 			for (uint8_t i = 0; i < numberDevices; i++)
 			{
 				// we check if the tag know us
@@ -658,9 +1520,9 @@ void DW1000RangingClass::loop()
 
 			// we create a new device with the tag
 			DW1000Device myTag(shortAddress);
-			myTag.setRXPower(DW1000.getReceivePower());
-			myTag.setFPPower(DW1000.getFirstPathPower());
-			myTag.setQuality(DW1000.getReceiveQuality());
+			myTag.setRXPower(rxDiag.rxPower);
+			myTag.setFPPower(rxDiag.fpPower);
+			myTag.setQuality(rxDiag.quality);
 
 			if (addNetworkDevices(&myTag))
 			{
@@ -692,9 +1554,9 @@ void DW1000RangingClass::loop()
 			_globalMac.decodeShortMACFrame(receivedData, address);
 			// we crate a new device with the anchor
 			DW1000Device myAnchor(address);
-			myAnchor.setRXPower(DW1000.getReceivePower());
-			myAnchor.setFPPower(DW1000.getFirstPathPower());
-			myAnchor.setQuality(DW1000.getReceiveQuality());
+			myAnchor.setRXPower(rxDiag.rxPower);
+			myAnchor.setFPPower(rxDiag.fpPower);
+			myAnchor.setQuality(rxDiag.quality);
 
 			// m_log::log_vrb(LOG_DW1000_MSG, "RANGING_INIT from %x", myAnchor.getShortAddress());
 
@@ -708,6 +1570,22 @@ void DW1000RangingClass::loop()
 
 			noteActivity();
 		}
+		else if (messageType == MessageType::BEACON || messageType == MessageType::JOIN)
+		{
+#if UWB_MAESTRO_ENABLE
+			byte address[2];
+			_globalMac.decodeShortMACFrame(receivedData, address);
+			if (messageType == MessageType::BEACON && _type == BoardType::TAG && g_maestroEnabled && g_superframeTag)
+			{
+				handleBeacon(address, rxDiag);
+			}
+			else if (messageType == MessageType::JOIN && _type == BoardType::ANCHOR && g_superframePeriodMs != 0 &&
+					 receivedData[6] == _ownShortAddress[0] && receivedData[5] == _ownShortAddress[1])
+			{
+				handleJoin(address);
+			}
+#endif
+		}
 		else
 		{
 			// we have a short mac layer frame !
@@ -716,14 +1594,21 @@ void DW1000RangingClass::loop()
 
 			// we get the device which correspond to the message which was sent (need to be filtered by MAC address)
 			DW1000Device *myDistantDevice = searchDistantDevice(address);
+#if UWB_MAESTRO_ENABLE
+			if (_type == BoardType::ANCHOR && g_superframePeriodMs != 0 && myDistantDevice != nullptr)
+			{
+				// the slot of a tag is kept as long as it is heard, whichever anchor it ranges with
+				myDistantDevice->noteActivity();
+			}
+#endif
 
 			// then we proceed to range protocol
 			if (_type == BoardType::ANCHOR)
 			{
-				if (myDistantDevice != nullptr && messageType != _expectedMsgId)
+				if (myDistantDevice != nullptr && messageType != myDistantDevice->expectedMsgId)
 				{
-					// unexpected message, start over again (except if already POLL)
-					_protocolFailed = true;
+					// unexpected message for this tag's session, start over again (except if already POLL)
+					myDistantDevice->protocolFailed = true;
 				}
 				if (messageType == MessageType::POLL)
 				{
@@ -732,9 +1617,9 @@ void DW1000RangingClass::loop()
 						// we create a new device with the tag
 						{
 							DW1000Device myTag(address);
-							myTag.setRXPower(DW1000.getReceivePower());
-							myTag.setFPPower(DW1000.getFirstPathPower());
-							myTag.setQuality(DW1000.getReceiveQuality());
+							myTag.setRXPower(rxDiag.rxPower);
+							myTag.setFPPower(rxDiag.fpPower);
+							myTag.setQuality(rxDiag.quality);
 							if (!addNetworkDevices(&myTag))
 							{
 								return;
@@ -743,8 +1628,9 @@ void DW1000RangingClass::loop()
 #if UWB_STRICT_MAC_DEST_FILTER
 			if (messageType == MessageType::POLL || messageType == MessageType::RANGE)
 			{
-				// Dest addr no MAC header (Short Address): [5]=MSB, [6]=LSB
-				if (receivedData[6] != _ownShortAddress[0] || receivedData[5] != _ownShortAddress[1])
+				// Dest addr no MAC header (Short Address): [5]=MSB, [6]=LSB, broadcast (rodada broadcast) passa
+				boolean broadcast = receivedData[5] == 0xFF && receivedData[6] == 0xFF;
+				if (!broadcast && (receivedData[6] != _ownShortAddress[0] || receivedData[5] != _ownShortAddress[1]))
 				{
 					// Não é pra mim -> ignora silenciosamente
 					return;
@@ -767,7 +1653,7 @@ void DW1000RangingClass::loop()
 						return;
 					}
 					
-					uint8_t numberDevices = receivedData[SHORT_MAC_LEN + 1];
+					uint8_t numberDevices = entriesInFrame(receivedData[SHORT_MAC_LEN + 1], rxDiag.dataLength, SHORT_MAC_LEN + 2, pollDeviceSize);
 
 					for (uint8_t i = 0; i < numberDevices; i++)
 					{
@@ -787,7 +1673,7 @@ void DW1000RangingClass::loop()
 
 							// we add the replyTime
 							uint16_t replyTime = getReplyTimeOfIndex(i);
-							// O offset base é calculado usando i * pollDeviceSize (que agora vale 10)
+							// O offset base é calculado usando i * pollDeviceSize (que agora vale 12)
 							int baseOffset = SHORT_MAC_LEN + 2 + i * pollDeviceSize;
 							
 							// Lê o Reply Time (Offset base + 2 bytes do endereço)
@@ -795,27 +1681,96 @@ void DW1000RangingClass::loop()
 
 							// --- LEITURA DO MPU ---
 							int16_t rx_ax, rx_ay, rx_az;
+							uint16_t imuAge;
 							memcpy(&rx_ax, receivedData + baseOffset + 4, 2);
 							memcpy(&rx_ay, receivedData + baseOffset + 6, 2);
 							memcpy(&rx_az, receivedData + baseOffset + 8, 2);
+							memcpy(&imuAge, receivedData + baseOffset + 10, 2);
 
 							// Salva no objeto do dispositivo (myDistantDevice)
 							// Certifique-se que DW1000Device.h tem essas variáveis publicas
 							myDistantDevice->mpu_ax = rx_ax;
 							myDistantDevice->mpu_ay = rx_ay;
 							myDistantDevice->mpu_az = rx_az;
+							// amostra na nossa base de tempo: RX do POLL menos a idade (o tempo de voo é desprezível)
+							myDistantDevice->setImuTimestamp(imuAge == imuAgeUnknown ? 0 :
+								DW1000Timebase::extend(rxDiag.timestamp) - DW1000Duration::fromMicroseconds(imuAge).getTicks());
 							// ----------------------
 
+							uint8_t exchangeId = DW1000Mac::decodeSequenceNumber(receivedData);
+							if (myDistantDevice->expectedMsgId == MessageType::RANGE && exchangeId == myDistantDevice->exchangeId)
+							{
+								// the same POLL again (already answered), the exchange goes on
+								myDistantDevice->protocolFailed = false;
+								return;
+							}
+
 							// on POLL we (re-)start, so no protocol failure
-							_protocolFailed = false;
+							myDistantDevice->protocolFailed = false;
+
+							// single-sided if the tag appended its last range after the entries, then maybe the link mode
+							int reportOffset = SHORT_MAC_LEN + 2 + numberDevices * pollDeviceSize;
+							int trailerLength = rxDiag.dataLength - reportOffset;
+							boolean singleSided = trailerLength >= singleSidedReportSize;
+							uint8_t link = 0;
+							if (trailerLength == 1 || trailerLength == singleSidedReportSize + 1)
+							{
+								link = receivedData[rxDiag.dataLength - 1];
+							}
+							if (link > g_linkModeCount)
+							{
+								link = 0;
+							}
 
-							DW1000.getReceiveTimestamp(myDistantDevice->timePollReceived);
+							if (isReplyPending())
+							{
+								// the reply to another tag is still scheduled and would be cancelled,
+								// this tag polls again
+								myDistantDevice->expectedMsgId = MessageType::POLL;
+								return;
+							}
+
+							myDistantDevice->timePollReceived = rxDiag.timestamp;
+							myDistantDevice->exchangeId = exchangeId;
+							myDistantDevice->linkMode = link;
+							if (link != g_linkModeActive)
+							{
+								// the answer and the RANGE in the mode asked by the tag, other tags wait meanwhile
+								switchLinkMode(link);
+							}
 							// we indicate our next receive message for our ranging protocol
-							_expectedMsgId = MessageType::RANGE;
-							transmitPollAck(myDistantDevice, replyTime);
+							myDistantDevice->expectedMsgId = singleSided ? MessageType::POLL : MessageType::RANGE;
+							transmitPollAck(myDistantDevice, replyTime, singleSided);
+							if (link != 0)
+							{
+								g_linkModeUntilUs = micros() + replyTime + g_linkModeSwitchUs;
+								if (!singleSided)
+								{
+									g_linkModeUntilUs += DW1000.getFrameAirtime(pollAckMaxLength) + linkReplyDelay(link) +
+														 DW1000.getFrameAirtime(SHORT_MAC_LEN + 2 + rangeDeviceSize);
+								}
+							}
 							#pragma GCC diagnostic pop
 							noteActivity();
 
+							if (singleSided)
+							{
+								float curRange;
+								float curRXPower;
+								memcpy(&curRange, receivedData + reportOffset, 4);
+								memcpy(&curRXPower, receivedData + reportOffset + 4, 4);
+								if (!isnan(curRange))
+								{
+									myDistantDevice->setRange(curRange);
+									myDistantDevice->setRangeTimestamp(DW1000Timebase::extend(rxDiag.timestamp));
+									myDistantDevice->setRXPower(curRXPower);
+									if (_handleNewRange != 0)
+									{
+										(*_handleNewRange)(myDistantDevice);
+									}
+								}
+							}
+
 							return;
 						}
 					}
@@ -837,8 +1792,7 @@ void DW1000RangingClass::loop()
 
 					// we receive a RANGE which is a broadcast message
 					// we need to grab info about it
-					uint8_t numberDevices = 0;
-					memcpy(&numberDevices, receivedData + SHORT_MAC_LEN + 1, 1);
+					uint8_t numberDevices = entriesInFrame(receivedData[SHORT_MAC_LEN + 1], rxDiag.dataLength, SHORT_MAC_LEN + 2, rangeDeviceSize);
 
 					for (uint8_t i = 0; i < numberDevices; i++)
 					{
@@ -853,11 +1807,19 @@ void DW1000RangingClass::loop()
 							myDistantDevice->noteActivity();
 
 							// we grab the replytime which is for us
-							DW1000.getReceiveTimestamp(myDistantDevice->timeRangeReceived);
+							myDistantDevice->timeRangeReceived = rxDiag.timestamp;
+							_rangeDueUs = micros();
 							noteActivity();
-							_expectedMsgId = MessageType::POLL;
+							myDistantDevice->expectedMsgId = MessageType::POLL;
+							// the exchange ends here, a link mode once the report (if any) is out
+							g_linkModeUntilUs = micros();
+							if (DW1000Mac::decodeSequenceNumber(receivedData) != myDistantDevice->exchangeId)
+							{
+								// RANGE of an other POLL than the one we answered: its timestamps don't match ours
+								myDistantDevice->protocolFailed = true;
+							}
 
-							if (!_protocolFailed)
+							if (!myDistantDevice->protocolFailed)
 							{
 
 								myDistantDevice->timePollAckReceivedMinusPollSent.setTimestamp(receivedData + SHORT_MAC_LEN + 4 + rangeDeviceSize * i);
@@ -871,37 +1833,34 @@ void DW1000RangingClass::loop()
 								DW1000Time myTOF;
 								computeRangeAsymmetric(myDistantDevice, &myTOF); // CHOSEN RANGING ALGORITHM
 
-								float distance = myTOF.getAsMeters();
+								float distance = myTOF.getAsMillimeters() / 1000.0f;
 
 								myDistantDevice->setRange(distance);
+								myDistantDevice->setRangeTimestamp(DW1000Timebase::extend(rxDiag.timestamp));
 
-								myDistantDevice->setRXPower(DW1000.getReceivePower());
-								myDistantDevice->setFPPower(DW1000.getFirstPathPower());
-								myDistantDevice->setQuality(DW1000.getReceiveQuality());
+								myDistantDevice->setRXPower(rxDiag.rxPower);
+								myDistantDevice->setFPPower(rxDiag.fpPower);
+								myDistantDevice->setQuality(rxDiag.quality);
 
-								if (ENABLE_RANGE_REPORT)
+								// the report is skipped rather than cancelling the reply to another tag
+								if (ENABLE_RANGE_REPORT && !isReplyPending())
 								{
 									uint16_t replyTime = getReplyTimeOfIndex(i);
 
 									// we send the range to TAG
 									transmitRangeReport(myDistantDevice, replyTime);
 								}
-
-								// we have finished our range computation. We send the corresponding handler
-								if (_handleNewRange != 0)
+								else
 								{
-									(*_handleNewRange)(myDistantDevice);
+									// it goes with the next POLL_ACK to this tag instead
+									myDistantDevice->hasPendingRange = true;
 								}
 
-#if UWB_MAESTRO_ENABLE
-					if (_type == BoardType::TAG && g_maestroEnabled)
-					{
-						g_maestroRetry = 0;
-						g_maestroAnchorIdx = (g_maestroAnchorIdx + 1) % g_maestroAnchorCount;
-						g_maestroStage = MAESTRO_INTER_DELAY;
-						g_maestroNextActionMs = millis() + g_maestroInterAnchorDelayMs;
-					}
-#endif
+								// we have finished our range computation. We send the corresponding handler
+								if (_handleNewRange != 0)
+								{
+									(*_handleNewRange)(myDistantDevice);
+								}
 							}
 							// else
 							// {
@@ -924,7 +1883,16 @@ void DW1000RangingClass::loop()
 
 				myDistantDevice->noteActivity();
 				// get message and parse
-				if (messageType != _expectedMsgId)
+				boolean expected = messageType == _expectedMsgId;
+#if UWB_MAESTRO_ENABLE
+				if (g_maestroEnabled && g_maestroPipelined)
+				{
+					// exchanges overlap, each anchor has its own expected message
+					expected = (messageType == MessageType::POLL_ACK && myDistantDevice->awaitingPollAck) ||
+							   (messageType == MessageType::RANGE_REPORT && myDistantDevice->awaitingRangeReport);
+				}
+#endif
+				if (!expected)
 				{
 					// unexpected message, start over again
 					// not needed ?
@@ -938,28 +1906,103 @@ void DW1000RangingClass::loop()
 				{
 					return;
 				}
+				if (DW1000Mac::decodeSequenceNumber(receivedData) != myDistantDevice->exchangeId)
+				{
+					// late answer to a POLL we already retried, its timestamps belong to that one
+					return;
+				}
 
 				if (messageType == MessageType::POLL_ACK)
 				{
-					DW1000.getReceiveTimestamp(myDistantDevice->timePollAckReceived);
+#if UWB_MAESTRO_ENABLE
+					// the pipeline answers the POLL_ACK it is waiting for, read before it is cleared
+					boolean pollAckAwaited = myDistantDevice->awaitingPollAck;
+#endif
+					myDistantDevice->awaitingPollAck = false;
+					myDistantDevice->timePollAckReceived = rxDiag.timestamp;
+#if UWB_MAESTRO_ENABLE
+					if (g_maestroEnabled)
+					{
+						maestroRecordSuccess(myDistantDevice->getByteShortAddress());
+					}
+#endif
 					// we note activity for our device:
 					myDistantDevice->noteActivity();
-					myDistantDevice->hasSentPoolAck = true;
 
+					float reportedRXPower = NAN;
+					if (!_singleSided && rxDiag.dataLength >= SHORT_MAC_LEN + 1 + piggybackReportSize)
+					{
+						// the anchor's range of our previous exchange with it
+						float curRange;
+						float curRXPower;
+						float curQuality;
+						uint32_t rangeAgeUs;
+						memcpy(&curRange, receivedData + SHORT_MAC_LEN + 1, 4);
+						memcpy(&curRXPower, receivedData + SHORT_MAC_LEN + 5, 4);
+						memcpy(&curQuality, receivedData + SHORT_MAC_LEN + 9, 4);
+						memcpy(&rangeAgeUs, receivedData + SHORT_MAC_LEN + 13, 4);
+						myDistantDevice->setRange(curRange);
+						// measured by the anchor at the RANGE of that exchange, rangeAgeUs before its POLL_ACK
+						myDistantDevice->setRangeTimestamp(DW1000Timebase::extend(rxDiag.timestamp) -
+														   DW1000Duration::fromMicroseconds(rangeAgeUs).getTicks());
+						myDistantDevice->setRXPower(curRXPower);
+						myDistantDevice->setQuality(curQuality);
+						reportedRXPower = curRXPower;
+						if (_handleNewRange != 0)
+						{
+							(*_handleNewRange)(myDistantDevice);
+						}
+					}
 
-#if UWB_MAESTRO_ENABLE
-					if (_type == BoardType::TAG && g_maestroEnabled)
+					if (_linkAdaptation)
 					{
-						g_maestroStage = MAESTRO_WAIT_RANGE_REPORT;
-						g_maestroDeadlineMs = millis() + g_maestroRangeTimeoutMs;
+						// mode of the next exchange: the weaker end of the link decides
+						float linkRXPower = isnan(reportedRXPower) ? rxDiag.rxPower : min(rxDiag.rxPower, reportedRXPower);
+						myDistantDevice->linkMode = linkModeFor(myDistantDevice->linkMode, linkRXPower, rxDiag.fpPower);
 					}
+
+					if (_singleSided && rxDiag.dataLength >= SHORT_MAC_LEN + 1 + DW1000Time::LENGTH_TIMESTAMP)
+					{
+						// single-sided exchange is complete, no RANGE to send
+						DW1000Time replyTime(receivedData + SHORT_MAC_LEN + 1);
+						DW1000Time myTOF;
+						computeRangeSingleSided(myDistantDevice, replyTime, rxDiag.clockOffset, &myTOF);
+
+						myDistantDevice->setRange(myTOF.getAsMeters());
+						myDistantDevice->setRangeTimestamp(DW1000Timebase::extend(rxDiag.timestamp));
+						myDistantDevice->setRXPower(rxDiag.rxPower);
+						myDistantDevice->setFPPower(rxDiag.fpPower);
+						myDistantDevice->setQuality(rxDiag.quality);
+						myDistantDevice->hasPendingRange = true;
+
+#if UWB_MAESTRO_ENABLE
+						if (g_maestroEnabled)
+						{
+							advanceToNextAnchor();
+						}
 #endif
+						if (_handleNewRange != 0)
+						{
+							(*_handleNewRange)(myDistantDevice);
+						}
+						return;
+					}
+
+					myDistantDevice->hasSentPoolAck = true;
+
 					// Serial.println(DW1000.getReceivePower());
 					// Serial.println(DW1000.getFirstPathPower());
 					// Serial.println(DW1000.getReceiveQuality());
 
 					// in the case the message come from our last device:
-					if (_replyTimeOfLastPollAck != 0 && myDistantDevice->getShortAddress() == _addressOfExpectedLastPollAck)
+					boolean lastPollAck = _replyTimeOfLastPollAck != 0 && myDistantDevice->getShortAddress() == _addressOfExpectedLastPollAck;
+#if UWB_MAESTRO_ENABLE
+					if (g_maestroEnabled && g_maestroPipelined)
+					{
+						lastPollAck = pollAckAwaited;
+					}
+#endif
+					if (lastPollAck)
 					{
 						// m_log::log_vrb(LOG_DW1000_MSG, "RANGE LAST POLLACK");
 						transmitRange();
@@ -977,8 +2020,25 @@ void DW1000RangingClass::loop()
 
 					// we have a new range to save !
 					myDistantDevice->setRange(curRange);
+					myDistantDevice->setRangeTimestamp(DW1000Timebase::extend(rxDiag.timestamp));
 					myDistantDevice->setRXPower(curRXPower);
+					myDistantDevice->awaitingRangeReport = false;
 
+#if UWB_MAESTRO_ENABLE
+					// pipelined the round went on when the RANGE was sent
+					if (g_maestroEnabled && !g_maestroPipelined && g_maestroStage == MAESTRO_WAIT_RANGE_REPORT)
+					{
+						// broadcast round: once every anchor of the RANGE has reported
+						if (g_maestroPendingReports > 0)
+						{
+							g_maestroPendingReports--;
+						}
+						if (g_maestroPendingReports == 0)
+						{
+							advanceToNextAnchor();
+						}
+					}
+#endif
 					// We can call our handler !
 					// we have finished our range computation. We send the corresponding handler
 					if (_handleNewRange != 0)
@@ -1005,6 +2065,7 @@ void DW1000RangingClass::handleSent()
 {
 	// status change on sent success
 	_sentAck = true;
+	_replyPending = false;
 }
 
 void DW1000RangingClass::handleReceived()
@@ -1013,6 +2074,52 @@ void DW1000RangingClass::handleReceived()
 	_receivedAck = true;
 }
 
+void DW1000RangingClass::handleReceiveTimeout()
+{
+	// the awaited answer can't come anymore (frame wait timeout armed by expectResponse())
+	_receiveTimeoutAck = true;
+}
+
+void DW1000RangingClass::handleLateTransmit()
+{
+	// the reply was dropped by the chip, no sent event will follow: listen again
+	m_log::log_err(LOG_DW1000, "Late TX");
+	_replyPending = false;
+	if (_handleLateTransmit != 0)
+	{
+		DW1000Device *myDistantDevice = searchDistantDevice(_lastSentToShortAddress);
+		if (myDistantDevice != nullptr)
+			(*_handleLateTransmit)(myDistantDevice);
+	}
+	receiver();
+}
+
+boolean DW1000RangingClass::isIdle()
+{
+	if (_sentAck || _receivedAck || isReplyPending() || g_linkModeActive != 0 || usUntil(_rangeDueUs, micros()) != 0)
+	{
+		return false;
+	}
+#if UWB_MAESTRO_ENABLE
+	// a Maestro tag only between two exchanges (IDLE only before the first one)
+	if (_type == BoardType::TAG && g_maestroEnabled && g_maestroStage != MAESTRO_INTER_DELAY && g_maestroStage != MAESTRO_IDLE)
+	{
+		return false;
+	}
+#endif
+	return true;
+}
+
+boolean DW1000RangingClass::isReplyPending()
+{
+	// the sent event clears it, the due time is a backstop if that event is lost
+	if (_replyPending && usUntil(_replyDueUs, micros()) == 0)
+	{
+		_replyPending = false;
+	}
+	return _replyPending;
+}
+
 void DW1000RangingClass::noteActivity()
 {
 	// update activity timestamp, so that we do not reach "resetPeriod"
@@ -1026,7 +2133,12 @@ void DW1000RangingClass::resetInactive()
 	{
 		if (_type == BoardType::ANCHOR)
 		{
-			_expectedMsgId = MessageType::POLL;
+			// every session starts over
+			for (uint8_t i = 0; i < _networkDevicesNumber; i++)
+			{
+				_networkDevices[i].expectedMsgId = MessageType::POLL;
+			}
+			_replyPending = false;
 			receiver();
 		}
 		noteActivity();
@@ -1035,6 +2147,13 @@ void DW1000RangingClass::resetInactive()
 
 void DW1000RangingClass::timerTick()
 {
+	if (_tdoa && _type == BoardType::TAG)
+	{
+		// TDOA: the BLINK is the whole exchange
+		transmitBlink();
+		return;
+	}
+
 #if UWB_MAESTRO_ENABLE
 	if (_type == BoardType::TAG && g_maestroEnabled)
 	{
@@ -1082,16 +2201,16 @@ void DW1000RangingClass::transmitInit()
 	DW1000.setDefaults();
 }
 
-void DW1000RangingClass::transmit(byte datas[])
+void DW1000RangingClass::transmit(byte datas[], uint16_t length)
 {
-	DW1000.setData(datas, LEN_DATA);
+	DW1000.setData(datas, length);
 	DW1000.startTransmit();
 }
 
-void DW1000RangingClass::transmit(byte datas[], DW1000Time time)
+void DW1000RangingClass::transmit(byte datas[], uint16_t length, DW1000Duration delay)
 {
-	DW1000.setDelay(time);
-	DW1000.setData(datas, LEN_DATA);
+	DW1000.setDelay(delay);
+	DW1000.setData(datas, length);
 	DW1000.startTransmit();
 }
 
@@ -1103,12 +2222,23 @@ void DW1000RangingClass::transmitBlink()
 	transmitInit();
 	_globalMac.generateBlinkFrame(sentData, _ownShortAddress);
 
+	if (_tdoa)
+	{
+		// no anchor list, no answer: the anchors only timestamp it
+		_timerDelay = _rangeInterval;
+		sentData[BLINK_MAC_LEN] = 0;
+		transmit(sentData, BLINK_MAC_LEN + 1);
+		byte shortBroadcast[2] = {0xFF, 0xFF};
+		copyShortAddress(_lastSentToShortAddress, shortBroadcast);
+		return;
+	}
+
 	sentData[BLINK_MAC_LEN] = _networkDevicesNumber;
 	for (uint8_t i = 0; i < _networkDevicesNumber; i++)
 	{
 		memcpy(sentData + BLINK_MAC_LEN + 1 + i * 2, _networkDevices[i].getByteShortAddress(), 2);
 	}
-	transmit(sentData);
+	transmit(sentData, BLINK_MAC_LEN + 1 + _networkDevicesNumber * 2);
 
 	byte shortBroadcast[2] = {0xFF, 0xFF};
 	copyShortAddress(_lastSentToShortAddress, shortBroadcast);
@@ -1125,8 +2255,8 @@ void DW1000RangingClass::transmitRangingInit(u_int16_t delay)
 
 	copyShortAddress(_lastSentToShortAddress, shortBroadcast);
 
-	DW1000Time deltaTime = DW1000Time(delay, DW1000Time::MICROSECONDS);
-	transmit(sentData, deltaTime);
+	DW1000Duration deltaTime = DW1000Duration::fromMicroseconds(delay);
+	transmit(sentData, SHORT_MAC_LEN + 1, deltaTime);
 }
 
 void DW1000RangingClass::transmitPoll()
@@ -1134,7 +2264,52 @@ void DW1000RangingClass::transmitPoll()
 	transmitInit();
 
 #if UWB_MAESTRO_ENABLE
-	if (_type == BoardType::TAG && g_maestroEnabled)
+	if (_type == BoardType::TAG && g_maestroEnabled && g_maestroBroadcastRound)
+	{
+		// === POLL BROADCAST (todas as âncoras da rodada, um slot de resposta para cada) ===
+		byte shortBroadcast[2] = {0xFF, 0xFF};
+		_globalMac.generateShortMACFrame(sentData, _ownShortAddress, shortBroadcast);
+		sentData[SHORT_MAC_LEN] = static_cast<byte>(MessageType::POLL);
+		uint8_t devicesCount = maestroRoundSize();
+		sentData[SHORT_MAC_LEN + 1] = devicesCount;
+
+		// Payload por âncora: [addr(2)][replyTime(2)][AX(2)][AY(2)][AZ(2)][idade IMU(2)]
+		// no superframe o POLL sai no início do slot, senão agora
+		int64_t pollTime = g_superframeSlotPending ? DW1000Timebase::extend(g_superframeSlotStart) : DW1000Timebase::now();
+		uint16_t replyTime = 0;
+		for (uint8_t i = 0; i < devicesCount; i++)
+		{
+			const byte *anchor = g_maestroAnchorList[(g_maestroAnchorIdx + i) % g_maestroAnchorCount];
+			int baseOffset = SHORT_MAC_LEN + 2 + i * pollDeviceSize;
+			replyTime = maestroReplySlot(i);
+			memcpy(sentData + baseOffset, anchor, 2);
+			memcpy(sentData + baseOffset + 2, &replyTime, 2);
+			writePollImu(sentData + baseOffset + 4, pollTime);
+
+			_addressOfExpectedLastPollAck = ((uint16_t)anchor[1] << 8) | anchor[0];
+		}
+
+		uint16_t pollLength = SHORT_MAC_LEN + 2 + devicesCount * pollDeviceSize;
+		uint32_t txDelay = 0;
+		if (g_superframeSlotPending)
+		{
+			// contention free: the POLL goes out exactly at the start of our slot
+			g_superframeSlotPending = false;
+			DW1000.scheduleTxAt(g_superframeSlotStart);
+			txDelay = usUntil(g_superframeSlotStartUs, micros());
+		}
+		// the wait ends with the slot of the last anchor
+		expectResponse(txDelay, pollLength, replyTime, pollAckMaxLength);
+
+		_replyTimeOfLastPollAck = replyTime / 1000;
+		_timeOfLastPollSent = millis();
+
+		copyShortAddress(_lastSentToShortAddress, shortBroadcast);
+
+		transmit(sentData, pollLength);
+		return;
+	}
+	else if (_type == BoardType::TAG && g_maestroEnabled)
 	{
 		// === POLL UNICAST (compatível com payload legado) ===
 		// Monta frame short MAC apontando para UMA âncora.
@@ -1143,19 +2318,65 @@ void DW1000RangingClass::transmitPoll()
 		// number of devices no payload
 		sentData[SHORT_MAC_LEN + 1] = 1;
 
-		// Payload legado: [addr(2)][replyTime(2)]
-		// Payload legado: [addr(2)][replyTime(2)][AX(2)][AY(2)][AZ(2)]
+		// Payload: [addr(2)][replyTime(2)][AX(2)][AY(2)][AZ(2)][idade IMU(2)]
         uint16_t replyTime = getReplyTimeOfIndex(0);
+		if (g_maestroPipelined && ENABLE_RANGE_REPORT)
+		{
+			// leaves the slot of the RANGE_REPORT still pending from the previous anchor free
+			replyTime += DW1000.getFrameAirtime(SHORT_MAC_LEN + 9) + g_maestroTimeoutMarginUs;
+		}
+
+		// a new exchange with this anchor, answers of other anchors are no longer expected
+		for (uint8_t i = 0; i < _networkDevicesNumber; i++)
+		{
+			_networkDevices[i].awaitingPollAck = false;
+		}
+		DW1000Device *polledAnchor = searchDistantDevice(g_maestroCurrentAnchor);
+		if (polledAnchor != nullptr)
+		{
+			polledAnchor->awaitingPollAck = true;
+			polledAnchor->awaitingRangeReport = false;
+		}
+
+		// link adaptation: the rest of the exchange in the mode chosen for this anchor (not pipelined,
+		// the next POLL would have to wait for the switch back)
+		uint8_t link = _linkAdaptation && !g_maestroPipelined && polledAnchor != nullptr ? linkCode(polledAnchor->linkMode) : 0;
+		replyTime += linkReplyDelay(link) - DEFAULT_REPLY_DELAY_TIME;
+		g_linkModePending = link;
         
         // 1. Endereço (Offset 0)
         memcpy(sentData + SHORT_MAC_LEN + 2, g_maestroCurrentAnchor, 2);
         // 2. Tempo de Resposta (Offset 2)
         memcpy(sentData + SHORT_MAC_LEN + 4, &replyTime, 2);
         
-        // 3. Dados do Acelerômetro (Offset 4, 6, 8)
-        memcpy(sentData + SHORT_MAC_LEN + 6, &_global_ax, 2);
-        memcpy(sentData + SHORT_MAC_LEN + 8, &_global_ay, 2);
-        memcpy(sentData + SHORT_MAC_LEN + 10, &_global_az, 2);
+        // 3. Dados do Acelerômetro e idade da amostra (Offset 4, 6, 8, 10), o POLL sai logo em seguida
+        writePollImu(sentData + SHORT_MAC_LEN + 6, DW1000Timebase::now());
+
+		uint16_t pollLength = SHORT_MAC_LEN + 2 + pollDeviceSize;
+		if (_singleSided)
+		{
+			// asks for a single-sided exchange and reports the last range with this anchor
+			float lastRange = NAN;
+			float lastRXPower = NAN;
+			DW1000Device *anchor = searchDistantDevice(g_maestroCurrentAnchor);
+			if (anchor != nullptr && anchor->hasPendingRange)
+			{
+				lastRange = anchor->getRange();
+				lastRXPower = anchor->getRXPower();
+				anchor->hasPendingRange = false;
+			}
+			memcpy(sentData + pollLength, &lastRange, 4);
+			memcpy(sentData + pollLength + 4, &lastRXPower, 4);
+			pollLength += singleSidedReportSize;
+		}
+		if (_linkAdaptation)
+		{
+			// last byte: link mode of the answer
+			sentData[pollLength++] = link;
+		}
+
+		uint16_t pollAckLength = _singleSided ? SHORT_MAC_LEN + 1 + DW1000Time::LENGTH_TIMESTAMP : pollAckMaxLength;
+		expectResponse(0, pollLength, replyTime, pollAckLength, linkMode(link));
 
         _addressOfExpectedLastPollAck = ((uint16_t)g_maestroCurrentAnchor[1] << 8) | g_maestroCurrentAnchor[0];
 		_replyTimeOfLastPollAck = replyTime / 1000;
@@ -1163,7 +2384,7 @@ void DW1000RangingClass::transmitPoll()
 
 		copyShortAddress(_lastSentToShortAddress, g_maestroCurrentAnchor);
 
-		transmit(sentData);
+		transmit(sentData, pollLength);
 		return;
 	}
 #endif
@@ -1184,6 +2405,7 @@ void DW1000RangingClass::transmitPoll()
 	sentData[SHORT_MAC_LEN + 1] = devicesCount;
 
 	uint8_t freeSlots = pollAckTimeSlots - devicesCount;
+	int64_t pollTime = DW1000Timebase::now();
 
 	for (uint8_t i = 0; i < devicesCount; i++)
 	{
@@ -1196,6 +2418,7 @@ void DW1000RangingClass::transmitPoll()
 		// we add the replyTime
 		uint16_t replyTime = _networkDevices[i].getReplyTime();
 		memcpy(sentData + SHORT_MAC_LEN + 2 + 2 + i * pollDeviceSize, &replyTime, 2);
+		writePollImu(sentData + SHORT_MAC_LEN + 2 + 4 + i * pollDeviceSize, pollTime);
 
 		_addressOfExpectedLastPollAck = _networkDevices[i].getShortAddress();
 	}
@@ -1208,18 +2431,51 @@ void DW1000RangingClass::transmitPoll()
 
 	copyShortAddress(_lastSentToShortAddress, shortBroadcast);
 
-	transmit(sentData);
+	transmit(sentData, SHORT_MAC_LEN + 2 + devicesCount * pollDeviceSize);
 }
 
-void DW1000RangingClass::transmitPollAck(DW1000Device *myDistantDevice, u_int16_t delay)
+void DW1000RangingClass::transmitPollAck(DW1000Device *myDistantDevice, u_int16_t delay, boolean withReplyTime)
 {
 	transmitInit();
 	_globalMac.generateShortMACFrame(sentData, _ownShortAddress, myDistantDevice->getByteShortAddress());
 	sentData[SHORT_MAC_LEN] = static_cast<byte>(MessageType::POLL_ACK);
-	// delay the same amount as ranging tag
-	DW1000Time deltaTime = DW1000Time(delay, DW1000Time::MICROSECONDS);
+	DW1000Mac::setSequenceNumber(sentData, myDistantDevice->exchangeId);
+	// reply at the time asked by the tag, counted from the reception of its POLL
+	DW1000Duration deltaTime = DW1000Duration::fromMicroseconds(delay);
+	DW1000Time timePollAckSent = DW1000.scheduleTxAt(myDistantDevice->timePollReceived + deltaTime);
+	uint16_t length = SHORT_MAC_LEN + 1;
+	if (withReplyTime)
+	{
+		// single-sided: the exact reply time is known before sending thanks to the scheduled TX
+		(timePollAckSent - myDistantDevice->timePollReceived).wrap().getTimestamp(sentData + length);
+		length += DW1000Time::LENGTH_TIMESTAMP;
+	}
+	else if (myDistantDevice->hasPendingRange)
+	{
+		// the range of the previous exchange, so the tag gets it without a RANGE_REPORT
+		float curRange = myDistantDevice->getRange();
+		float curRXPower = myDistantDevice->getRXPower();
+		float curQuality = myDistantDevice->getQuality();
+		// measured at the RX of the RANGE, within one wrap of the 40 bit clock (~17 s) of this POLL_ACK
+		uint32_t rangeAgeUs = DW1000Timebase::toMicroseconds((timePollAckSent - myDistantDevice->timeRangeReceived).wrap().getTimestamp());
+		memcpy(sentData + length, &curRange, 4);
+		memcpy(sentData + length + 4, &curRXPower, 4);
+		memcpy(sentData + length + 8, &curQuality, 4);
+		memcpy(sentData + length + 12, &rangeAgeUs, 4);
+		length += piggybackReportSize;
+		myDistantDevice->hasPendingRange = false;
+	}
+	myDistantDevice->timePollAckSent = timePollAckSent;
 	copyShortAddress(_lastSentToShortAddress, myDistantDevice->getByteShortAddress());
-	transmit(sentData, deltaTime);
+	_replyPending = true;
+	_replyDueUs = micros() + delay + DW1000.getFrameAirtime(length);
+	if (!withReplyTime)
+	{
+		// the RANGE comes after the POLL_ACK slots of the round, a bound is enough
+		_rangeDueUs = _replyDueUs + getReplyTimeOfIndex(pollAckTimeSlots - 1) + linkReplyDelay(g_linkModeActive) +
+					  DW1000.getFrameAirtime(SHORT_MAC_LEN + 2 + devicePerPollTransmit * rangeDeviceSize) + DEFAULT_REPLY_DELAY_TIME;
+	}
+	transmit(sentData, length);
 }
 
 void DW1000RangingClass::transmitRange()
@@ -1232,7 +2488,83 @@ void DW1000RangingClass::transmitRange()
 	_expectedMsgId = ENABLE_RANGE_REPORT ? MessageType::RANGE_REPORT : MessageType::POLL_ACK;
 
 #if UWB_MAESTRO_ENABLE
-	if (_type == BoardType::TAG && g_maestroEnabled)
+	if (_type == BoardType::TAG && g_maestroEnabled && g_maestroBroadcastRound)
+	{
+		// === RANGE BROADCAST (timestamps de todas as âncoras da rodada que responderam POLL_ACK) ===
+		uint8_t devicesCount = 0;
+		DW1000Device *devices[devicePerPollTransmit];
+		boolean lastSlotAnswered = false;
+		uint8_t roundSize = maestroRoundSize();
+		for (uint8_t i = 0; i < roundSize; i++)
+		{
+			byte address[2];
+			memcpy(address, g_maestroAnchorList[(g_maestroAnchorIdx + i) % g_maestroAnchorCount], 2);
+			DW1000Device *anchor = searchDistantDevice(address);
+			if (anchor != nullptr && anchor->hasSentPoolAck)
+			{
+				devices[devicesCount++] = anchor;
+				lastSlotAnswered = (i == roundSize - 1);
+			}
+		}
+
+		if (devicesCount == 0)
+		{
+			// Nenhuma âncora respondeu (POLL_ACK). Não envia RANGE.
+			receiver();
+			return;
+		}
+
+		_timerDelay = _rangeInterval;
+
+		transmitInit();
+
+		byte shortBroadcast[2] = {0xFF, 0xFF};
+		_globalMac.generateShortMACFrame(sentData, _ownShortAddress, shortBroadcast);
+		sentData[SHORT_MAC_LEN] = static_cast<byte>(MessageType::RANGE);
+		// every anchor of the round answered the same POLL
+		DW1000Mac::setSequenceNumber(sentData, devices[0]->exchangeId);
+		sentData[SHORT_MAC_LEN + 1] = devicesCount;
+
+		// after the last slot relative to its POLL_ACK, after a timeout relative to now
+		DW1000Duration deltaTime = DW1000Duration::fromMicroseconds(DEFAULT_REPLY_DELAY_TIME);
+		DW1000Time timeRangeSent = lastSlotAnswered
+			? DW1000.scheduleTxAt(devices[devicesCount - 1]->timePollAckReceived + deltaTime)
+			: DW1000.setDelay(deltaTime);
+
+		for (uint8_t i = 0; i < devicesCount; i++)
+		{
+			if (ENABLE_RANGE_REPORT)
+				// each anchor reports in the slot of its index
+				devices[i]->setReplyTime(getReplyTimeOfIndex(i));
+
+			memcpy(sentData + SHORT_MAC_LEN + 2 + rangeDeviceSize * i, devices[i]->getByteShortAddress(), 2);
+
+			devices[i]->timeRangeSent = timeRangeSent;
+			devices[i]->timePollAckReceivedMinusPollSent = devices[i]->timePollAckReceived - devices[i]->timePollSent;
+			devices[i]->timeRangeSentMinusPollAckReceived = devices[i]->timeRangeSent - devices[i]->timePollAckReceived;
+			devices[i]->timePollAckReceivedMinusPollSent.getTimestamp(sentData + SHORT_MAC_LEN + 4 + rangeDeviceSize * i);
+			devices[i]->timeRangeSentMinusPollAckReceived.getTimestamp(sentData + SHORT_MAC_LEN + 9 + rangeDeviceSize * i);
+		}
+
+		uint16_t rangeLength = SHORT_MAC_LEN + 2 + devicesCount * rangeDeviceSize;
+		if (ENABLE_RANGE_REPORT)
+		{
+			g_maestroPendingReports = devicesCount;
+			expectResponse(DEFAULT_REPLY_DELAY_TIME, rangeLength, getReplyTimeOfIndex(devicesCount - 1), SHORT_MAC_LEN + 9);
+		}
+		else
+		{
+			// only a backstop in case the sent event is lost
+			g_maestroDeadlineUs = micros() + DEFAULT_REPLY_DELAY_TIME + DW1000.getFrameAirtime(rangeLength) + g_maestroTimeoutMarginUs;
+		}
+		g_maestroStage = MAESTRO_WAIT_RANGE_REPORT;
+
+		copyShortAddress(_lastSentToShortAddress, shortBroadcast);
+
+		transmit(sentData, rangeLength);
+		return;
+	}
+	else if (_type == BoardType::TAG && g_maestroEnabled)
 	{
 		// === RANGE UNICAST (somente para a âncora que respondeu POLL_ACK) ===
 		DW1000Device *target = nullptr;
@@ -1260,14 +2592,27 @@ void DW1000RangingClass::transmitRange()
 		// Frame UNICAST para a âncora alvo
 		_globalMac.generateShortMACFrame(sentData, _ownShortAddress, target->getByteShortAddress());
 		sentData[SHORT_MAC_LEN] = static_cast<byte>(MessageType::RANGE);
+		DW1000Mac::setSequenceNumber(sentData, target->exchangeId);
 		sentData[SHORT_MAC_LEN + 1] = 1;
 
-		// delay sending the message and remember expected future sent timestamp
-		DW1000Time deltaTime = DW1000Time(DEFAULT_REPLY_DELAY_TIME, DW1000Time::MICROSECONDS);
-		DW1000Time timeRangeSent = DW1000.setDelay(deltaTime);
+		// send relative to the POLL_ACK reception and remember expected future sent timestamp
+		uint16_t rangeDelay = linkReplyDelay(g_linkModeActive);
+		DW1000Duration deltaTime = DW1000Duration::fromMicroseconds(rangeDelay);
+		DW1000Time timeRangeSent = DW1000.scheduleTxAt(target->timePollAckReceived + deltaTime);
 
 		if (ENABLE_RANGE_REPORT)
+		{
 			target->setReplyTime(getReplyTimeOfIndex(0));
+			target->awaitingRangeReport = true;
+			expectResponse(rangeDelay, SHORT_MAC_LEN + 2 + rangeDeviceSize, target->getReplyTime(), SHORT_MAC_LEN + 9);
+		}
+		else
+		{
+			// only a backstop in case the sent event is lost
+			g_maestroDeadlineUs = micros() + rangeDelay + DW1000.getFrameAirtime(SHORT_MAC_LEN + 2 + rangeDeviceSize) + g_maestroTimeoutMarginUs;
+		}
+		g_maestroPendingReports = 1;
+		g_maestroStage = MAESTRO_WAIT_RANGE_REPORT;
 
 		memcpy(sentData + SHORT_MAC_LEN + 2, target->getByteShortAddress(), 2);
 
@@ -1279,7 +2624,7 @@ void DW1000RangingClass::transmitRange()
 
 		copyShortAddress(_lastSentToShortAddress, target->getByteShortAddress());
 
-		transmit(sentData);
+		transmit(sentData, SHORT_MAC_LEN + 2 + rangeDeviceSize);
 		return;
 	}
 #endif
@@ -1313,11 +2658,16 @@ void DW1000RangingClass::transmitRange()
 	byte shortBroadcast[2] = {0xFF, 0xFF};
 	_globalMac.generateShortMACFrame(sentData, _ownShortAddress, shortBroadcast);
 	sentData[SHORT_MAC_LEN] = static_cast<byte>(MessageType::RANGE);
+	if (devicesCount > 0)
+	{
+		// every device of the RANGE answered the same POLL
+		DW1000Mac::setSequenceNumber(sentData, devices[0]->exchangeId);
+	}
 	// we enter the number of devices
 	sentData[SHORT_MAC_LEN + 1] = devicesCount;
 
 	// delay sending the message and remember expected future sent timestamp
-	DW1000Time deltaTime = DW1000Time(DEFAULT_REPLY_DELAY_TIME, DW1000Time::MICROSECONDS);
+	DW1000Duration deltaTime = DW1000Duration::fromMicroseconds(DEFAULT_REPLY_DELAY_TIME);
 	DW1000Time timeRangeSent = DW1000.setDelay(deltaTime);
 
 	for (uint8_t i = 0; i < devicesCount; i++)
@@ -1339,7 +2689,7 @@ void DW1000RangingClass::transmitRange()
 
 	copyShortAddress(_lastSentToShortAddress, shortBroadcast);
 
-	transmit(sentData);
+	transmit(sentData, SHORT_MAC_LEN + 2 + devicesCount * rangeDeviceSize);
 }
 
 void DW1000RangingClass::transmitRangeReport(DW1000Device *myDistantDevice, u_int16_t delay)
@@ -1347,6 +2697,7 @@ void DW1000RangingClass::transmitRangeReport(DW1000Device *myDistantDevice, u_in
 	transmitInit();
 	_globalMac.generateShortMACFrame(sentData, _ownShortAddress, myDistantDevice->getByteShortAddress());
 	sentData[SHORT_MAC_LEN] = static_cast<byte>(MessageType::RANGE_REPORT);
+	DW1000Mac::setSequenceNumber(sentData, myDistantDevice->exchangeId);
 	// write final ranging result
 	float curRange = myDistantDevice->getRange();
 	float curRXPower = myDistantDevice->getRXPower();
@@ -1354,7 +2705,10 @@ void DW1000RangingClass::transmitRangeReport(DW1000Device *myDistantDevice, u_in
 	memcpy(sentData + 1 + SHORT_MAC_LEN, &curRange, 4);
 	memcpy(sentData + 5 + SHORT_MAC_LEN, &curRXPower, 4);
 	copyShortAddress(_lastSentToShortAddress, myDistantDevice->getByteShortAddress());
-	transmit(sentData, DW1000Time(delay, DW1000Time::MICROSECONDS));
+	DW1000.scheduleTxAt(myDistantDevice->timeRangeReceived + DW1000Duration::fromMicroseconds(delay));
+	_replyPending = true;
+	_replyDueUs = micros() + delay + DW1000.getFrameAirtime(SHORT_MAC_LEN + 9);
+	transmit(sentData, SHORT_MAC_LEN + 9);
 }
 
 void DW1000RangingClass::transmitRangeFailed(DW1000Device *myDistantDevice)
@@ -1364,15 +2718,207 @@ void DW1000RangingClass::transmitRangeFailed(DW1000Device *myDistantDevice)
 	sentData[SHORT_MAC_LEN] = static_cast<byte>(MessageType::RANGE_FAILED);
 
 	copyShortAddress(_lastSentToShortAddress, myDistantDevice->getByteShortAddress());
-	transmit(sentData);
+	transmit(sentData, SHORT_MAC_LEN + 1);
+}
+
+void DW1000RangingClass::transmitBeacon()
+{
+#if UWB_MAESTRO_ENABLE
+	// the slots of tags no longer heard are free again
+	for (uint8_t i = 0; i < g_superframeSlotCount; i++)
+	{
+		if (g_superframeSlots[i][0] == 0 && g_superframeSlots[i][1] == 0)
+		{
+			continue;
+		}
+		DW1000Device *tag = searchDistantDevice(g_superframeSlots[i]);
+		if (tag == nullptr || tag->isInactive())
+		{
+			memset(g_superframeSlots[i], 0, 2);
+		}
+	}
+
+	transmitInit();
+	byte shortBroadcast[2] = {0xFF, 0xFF};
+	_globalMac.generateShortMACFrame(sentData, _ownShortAddress, shortBroadcast);
+	sentData[SHORT_MAC_LEN] = static_cast<byte>(MessageType::BEACON);
+	sentData[SHORT_MAC_LEN + 1] = g_superframeSeq++;
+	sentData[SHORT_MAC_LEN + 2] = g_superframeSlotCount;
+	memcpy(sentData + SHORT_MAC_LEN + 3, &g_superframeSlotLengthUs, 4);
+	memcpy(sentData + SHORT_MAC_LEN + 7, &g_superframeGuardUs, 2);
+	memcpy(sentData + g_superframeHeaderLength, g_superframeSlots, 2 * g_superframeSlotCount);
+	copyShortAddress(_lastSentToShortAddress, shortBroadcast);
+
+	// one period after the last BEACON, unless we fell behind
+	uint32_t periodUs = g_superframePeriodMs * 1000UL;
+	g_superframeNextBeaconUs += periodUs;
+	if (usUntil(g_superframeNextBeaconUs, micros()) == 0)
+	{
+		g_superframeNextBeaconUs = micros() + periodUs;
+	}
+	maestroWakeUpIn(usUntil(g_superframeNextBeaconUs, micros()));
+
+	transmit(sentData, g_superframeHeaderLength + 2 * g_superframeSlotCount);
+#endif
+}
+
+void DW1000RangingClass::handleJoin(byte address[])
+{
+#if UWB_MAESTRO_ENABLE
+	// the tag is followed as a device, so its slot is freed once it is no longer heard
+	DW1000Device *tag = searchDistantDevice(address);
+	if (tag == nullptr)
+	{
+		DW1000Device newTag(address);
+		if (addNetworkDevices(&newTag) && _handleNewDevice != 0)
+		{
+			(*_handleNewDevice)(&newTag);
+		}
+		tag = searchDistantDevice(address);
+		if (tag == nullptr)
+		{
+			return;
+		}
+	}
+	tag->noteActivity();
+
+	// granted in the next BEACON; without a free slot the tag keeps asking
+	int16_t freeSlot = -1;
+	for (uint8_t i = 0; i < g_superframeSlotCount; i++)
+	{
+		if (memcmp(g_superframeSlots[i], address, 2) == 0)
+		{
+			return;
+		}
+		if (freeSlot < 0 && g_superframeSlots[i][0] == 0 && g_superframeSlots[i][1] == 0)
+		{
+			freeSlot = i;
+		}
+	}
+	if (freeSlot >= 0)
+	{
+		memcpy(g_superframeSlots[freeSlot], address, 2);
+	}
+#endif
+}
+
+void DW1000RangingClass::transmitTdoaSync()
+{
+	_tdoaLastSync = millis();
+	transmitInit();
+	byte shortBroadcast[2] = {0xFF, 0xFF};
+	_globalMac.generateShortMACFrame(sentData, _ownShortAddress, shortBroadcast);
+	sentData[SHORT_MAC_LEN] = static_cast<byte>(MessageType::SYNC);
+	memcpy(sentData + SHORT_MAC_LEN + 1, &_tdoaSyncPeriod, 2);
+	// sent at a known time, so the frame carries its own TX timestamp
+	DW1000Time now;
+	DW1000.getSystemTimestamp(now);
+	DW1000Time timeSyncSent = DW1000.scheduleTxAt(now + DW1000Duration::fromMicroseconds(DEFAULT_REPLY_DELAY_TIME));
+	timeSyncSent.setTimestamp(timeSyncSent.getTimestamp() & DW1000Time::TIME_MAX);
+	timeSyncSent.getTimestamp(sentData + SHORT_MAC_LEN + 3);
+	copyShortAddress(_lastSentToShortAddress, shortBroadcast);
+	transmit(sentData, SHORT_MAC_LEN + 3 + DW1000Time::LENGTH_TIMESTAMP);
+}
+
+void DW1000RangingClass::handleTdoaSync(byte address[], const RxDiagnostics &rxDiag)
+{
+	int64_t local = rxDiag.timestamp.getTimestamp();
+	int64_t reference = DW1000Time(receivedData + SHORT_MAC_LEN + 3).getTimestamp();
+	uint32_t currentTime = millis();
+	memcpy(&g_tdoaSyncPeriodMs, receivedData + SHORT_MAC_LEN + 1, 2);
+
+	if (g_tdoaSyncCount == 0 || memcmp(address, g_tdoaReference, 2) != 0 ||
+		currentTime - g_tdoaSyncMs > 4 * (uint32_t)g_tdoaSyncPeriodMs)
+	{
+		// new reference or SYNCs lost: the model starts over from this one
+		copyShortAddress(g_tdoaReference, address);
+		g_tdoaSkew = 0;
+		g_tdoaSyncCount = 1;
+	}
+	else
+	{
+		int64_t localElapsed = tdoaElapsed(local, g_tdoaSyncLocal);
+		int64_t referenceElapsed = tdoaElapsed(reference, g_tdoaSyncRef);
+		if (localElapsed > 0)
+		{
+			float skew = (float)(referenceElapsed - localElapsed) / localElapsed;
+			// the first measurement as is, then averaged against the RX timestamp noise
+			g_tdoaSkew = g_tdoaSyncCount == 1 ? skew : g_tdoaSkew + (skew - g_tdoaSkew) / 4;
+			if (g_tdoaSyncCount < 255)
+			{
+				g_tdoaSyncCount++;
+			}
+		}
+	}
+	g_tdoaSyncLocal = local;
+	g_tdoaSyncRef = reference;
+	g_tdoaSyncMs = currentTime;
+}
+
+void DW1000RangingClass::handleTdoaBlink(const RxDiagnostics &rxDiag)
+{
+	if (_handleTdoaSample == 0)
+	{
+		return;
+	}
+	byte shortAddress[2];
+	_globalMac.decodeBlinkFrame(receivedData, shortAddress);
+
+	TdoaSample sample;
+	sample.tagAddress = shortAddress[1] * 256 + shortAddress[0];
+	sample.sequence = receivedData[1];
+	sample.rxPower = rxDiag.rxPower;
+	int64_t local = rxDiag.timestamp.getTimestamp();
+	if (_tdoaSyncPeriod != 0)
+	{
+		// the reference clock is ours
+		sample.timestamp = local;
+		sample.synchronized = true;
+	}
+	else
+	{
+		int64_t elapsed = tdoaElapsed(local, g_tdoaSyncLocal);
+		sample.timestamp = (g_tdoaSyncRef + elapsed + (int64_t)(elapsed * g_tdoaSkew)) & DW1000Time::TIME_MAX;
+		sample.synchronized = g_tdoaSyncCount >= 2 && millis() - g_tdoaSyncMs <= 4 * (uint32_t)g_tdoaSyncPeriodMs;
+	}
+	(*_handleTdoaSample)(sample);
+}
+
+void DW1000RangingClass::switchLinkMode(uint8_t code)
+{
+	if (g_linkModeActive == 0)
+	{
+		g_networkAntennaDelay = DW1000.getAntennaDelay();
+	}
+	DW1000.switchMode(linkMode(code));
+	// the tuning of the new mode overwrote the amplifier settings
+	if (g_highPower)
+	{
+		DW1000.high_power_init();
+	}
+	uint16_t delay = g_networkAntennaDelay;
+	if (code != 0 && code <= g_linkModeCount && g_linkModeAntennaDelay[code - 1] != 0)
+	{
+		delay = g_linkModeAntennaDelay[code - 1];
+	}
+	if (delay != DW1000.getAntennaDelay())
+	{
+		DW1000.setAntennaDelay(delay);
+	}
+	g_linkModeActive = code;
 }
 
 void DW1000RangingClass::receiver()
 {
 	DW1000.newReceive();
 	DW1000.setDefaults();
-	// so we don't need to restart the receiver manually
+	DW1000.setDoubleBuffering(_doubleBuffering);
+	// so we don't need to restart the receiver manually (also writes the double buffering config)
 	DW1000.receivePermanently(true);
+	if (_doubleBuffering)
+	{
+		DW1000.syncReceiveBuffers();
+	}
 	DW1000.startReceive();
 }
 
@@ -1393,7 +2939,9 @@ void DW1000RangingClass::computeRangeAsymmetric(DW1000Device *myDistantDevice, D
 	DW1000Time round2 = (myDistantDevice->timeRangeReceived - myDistantDevice->timePollAckSent).wrap();
 	DW1000Time reply2 = (myDistantDevice->timeRangeSentMinusPollAckReceived).wrap();
 
-	myTOF->setTimestamp((round1 * round2 - reply1 * reply2) / (round1 + round2 + reply1 + reply2));
+	// the products of two 40 bit durations don't fit in 64 bits, this is exact
+	myTOF->setTimestamp(DW1000Time::asymmetricTimeOfFlight(round1.getTimestamp(), reply1.getTimestamp(),
+														   round2.getTimestamp(), reply2.getTimestamp()));
 
 	/*
 	m_log::log_vrb(LOG_DW1000_MSG, "timePollAckReceivedMinusPollSent %d", myDistantDevice->timePollAckReceivedMinusPollSent.getTimestamp());
@@ -1411,3 +2959,12 @@ void DW1000RangingClass::computeRangeAsymmetric(DW1000Device *myDistantDevice, D
 	m_log::log_vrb(LOG_DW1000_MSG, "reply2 ", (long)reply2.getTimestamp());
 	*/
 }
+
+void DW1000RangingClass::computeRangeSingleSided(DW1000Device *myDistantDevice, const DW1000Time &replyTime, float clockOffset, DW1000Time *myTOF)
+{
+	// single-sided two-way ranging (two frames), the reply time counted by the anchor is brought
+	// to our clock with the offset measured on its POLL_ACK, which removes the drift error
+	int64_t round = (myDistantDevice->timePollAckReceived - myDistantDevice->timePollSent).wrap().getTimestamp();
+	int64_t reply = replyTime.getTimestamp();
+	myTOF->setTimestamp((round - reply + (int64_t)(reply * clockOffset)) / 2);
+}
@@ -30,6 +30,7 @@
 #include "DW1000Time.h"
 #include "DW1000Device.h"
 #include "DW1000Mac.h"
+#include "DW1000Timebase.h"
 
 //Log tags
 
@@ -42,6 +43,9 @@ enum class MessageType : byte
 	RANGE_REPORT = 3,
 	BLINK = 4,
 	RANGING_INIT = 5,
+	BEACON = 6,
+	JOIN = 7,
+	SYNC = 8,
 	TYPE_ERROR = 254,
 	RANGE_FAILED = 255,
 };
@@ -77,6 +81,27 @@ enum class BoardType : byte
 
 #define ENABLE_RANGE_REPORT false
 
+/* TAG (Maestro): link state of an anchor of the list, see getAnchorHealth(). */
+struct AnchorHealth
+{
+	uint8_t successRate = 255;       // share of answered POLLs, exponential average (255 = all)
+	uint8_t consecutiveFailures = 0; // exchanges failed in a row
+	uint8_t weight = 1;              // share of the schedule, 0 = not scheduled
+	uint32_t retryAtMs = 0;          // skipped until this millis() while failing (backoff)
+	uint32_t lastSuccessMs = 0;      // millis() of the last POLL_ACK, 0 if never
+};
+
+/* ANCHOR (TDOA): a BLINK timestamped by this anchor, see attachTdoaSample(). */
+struct TdoaSample
+{
+	uint16_t tagAddress;  // short address of the tag
+	uint8_t sequence;     // MAC sequence number of the BLINK, the same on every anchor
+	int64_t timestamp;    // RX time in the clock of the reference anchor (40 bit), including the time of
+	                      // flight from the reference to this anchor, the solver removes it
+	float rxPower;
+	boolean synchronized; // false without a recent clock model (two SYNCs), always true on the reference
+};
+
 class DW1000RangingClass
 {
 public:
@@ -86,15 +111,90 @@ public:
 
 	static void loop();
 
+	/* Event driven operation: the given task (usually the caller of loop()) is notified by the DW1000 IRQ
+	   and waitForEvent() sleeps until that notification or the next protocol deadline. */
+	static void useTaskNotification(TaskHandle_t task);
+	static void waitForEvent();
+	/* No exchange in progress (nothing in flight, no reply due, ANCHOR: no RANGE awaited): the moment to
+	   change the antenna delay, which must be the same for every timestamp of an exchange. */
+	static boolean isIdle();
+
+	/* Receive into two alternating buffers, so a frame arriving while the last one is read is kept. */
+	static void useDoubleBuffering(boolean val) { _doubleBuffering = val; };
+
+	/* TAG (Maestro): range from POLL/POLL_ACK alone, correcting the anchor clock drift with the carrier
+	   integrator. The result is reported locally and carried to the anchor in the next POLL. */
+	static void useSingleSidedRanging(boolean val);
+
+	/* TAG (Maestro): one broadcast POLL for all anchors of the round (each in its own reply slot) and one
+	   RANGE with all their timestamps, so every range of the round refers to the same POLL. */
+	static void useBroadcastRound(boolean val);
+
+	/* TAG (Maestro): POLL the next anchor as soon as the RANGE of the current one is sent. With
+	   ENABLE_RANGE_REPORT its RANGE_REPORT is received meanwhile (needs a mode where the POLL fits before
+	   the report), without it the inter-anchor delay is skipped. Unicast only. */
+	static void usePipelinedExchanges(boolean val);
+
+	/* TAG (Maestro): anchors failing in a row are skipped with exponential backoff and probed again
+	   afterwards, the others are scheduled by weighted round-robin (all weights 1 = plain round-robin).
+	   While every anchor backs off the tag waits for the first one to be due. The weight is a share of
+	   the schedule, e.g. higher for anchors with better geometry or signal; it is kept across init(),
+	   a new useMaestroAnchors() list starts again with weight 1. RX power and quality of an anchor
+	   are in its DW1000Device. */
+	static boolean getAnchorHealth(uint8_t index, AnchorHealth &health);
+	/* TAG (Maestro, call before init()): the anchors to range with instead of the built-in list,
+	   at most MAX_DEVICES; an empty list is ignored. The index of getAnchorHealth() is the position in this list. */
+	static void useMaestroAnchors(const uint16_t shortAddresses[], uint8_t count);
+	static void setAnchorWeight(uint8_t index, uint8_t weight);
+
+	/* ANCHOR (Maestro): emit a BEACON every periodMs (0 = off) with the slot table of a TDMA superframe.
+	   Slot length and count follow from the configured mode; a tag joins in the first slot and keeps
+	   its slot until it is no longer heard (see INACTIVITY_TIME). Only one anchor coordinates. A period
+	   too short for one slot besides the join slot is refused (logged, superframe off). */
+	static void coordinateSuperframe(uint16_t periodMs);
+	/* TAG (Maestro): follow the BEACONs, ranging with one broadcast round in the granted slot only.
+	   Without BEACONs for a while the tag falls back to clocking its rounds itself. */
+	static void useSuperframe(boolean val);
+
+	/* TDOA (call after init()): a TAG only transmits a BLINK every range interval, an ANCHOR timestamps
+	   BLINKs in the clock of the reference anchor and hands them to attachTdoaSample() instead of ranging. */
+	static void useTdoaBlinks(boolean val);
+	/* ANCHOR (TDOA): be the reference, sending a SYNC every syncPeriodMs (0 = off) from which the
+	   other anchors model their clock offset and drift. */
+	static void useTdoaReference(uint16_t syncPeriodMs);
+
+	/* TAG (Maestro, unicast): per anchor PHY mode for POLL_ACK, RANGE and RANGE_REPORT, from the RX power
+	   and first path measured by both ends. The POLL stays in the network mode so every anchor hears it,
+	   and tells the anchor which mode to answer in; anchors always follow. Only modes faster than the
+	   network mode are used, with its PRF: configure a robust network mode (e.g. 110 kb/s, PL1024) and the
+	   close anchors answer faster, the far ones stay in it. With the fast default (6.8 Mb/s, PL64) there
+	   is nothing faster and nothing changes. */
+	static void useLinkAdaptation(boolean val) { _linkAdaptation = val; };
+	/* Antenna delay calibrated in link mode code (1 = 6.8 Mb/s PL64, 2 = 6.8 Mb/s PL128, 3 = 850 kb/s
+	   PL256, 4 = 110 kb/s PL1024, all with the network PRF), 0 = the one of the network mode (default). */
+	static void setLinkModeAntennaDelay(uint8_t code, uint16_t delay);
+
+	/* Sample the temperature and supply voltage of the DW1000 every periodMs (0 = off) between exchanges,
+	   and shift the antenna delay by ticksPerDegree for each degree C away from referenceTemp (the
+	   temperature at calibration). The readings are smoothed, NAN before the first sample. */
+	static void useDriftCompensation(uint16_t periodMs, float ticksPerDegree, float referenceTemp);
+	static float getTemperature() { return _temperature; };
+	static float getVoltage() { return _voltage; };
+
 	// Handlers
 	static void attachNewRange(void (*handleNewRange)(DW1000Device *)) { _handleNewRange = handleNewRange; };
 	static void attachBlinkDevice(void (*handleBlinkDevice)(DW1000Device *)) { _handleBlinkDevice = handleBlinkDevice; };
 	static void attachNewDevice(void (*handleNewDevice)(DW1000Device *)) { _handleNewDevice = handleNewDevice; };
 	static void attachInactiveDevice(void (*handleInactiveDevice)(DW1000Device *)) { _handleInactiveDevice = handleInactiveDevice; };
 	static void attachRemovedDeviceMaxReached(void (*handleRemovedDeviceMaxReached)(DW1000Device *)) { _handleRemovedDeviceMaxReached = handleRemovedDeviceMaxReached; };
+	// a reply scheduled from an RX timestamp missed its deadline and was not sent
+	static void attachLateTransmit(void (*handleLateTransmit)(DW1000Device *)) { _handleLateTransmit = handleLateTransmit; };
+	static void attachTdoaSample(void (*handleTdoaSample)(const TdoaSample &)) { _handleTdoaSample = handleTdoaSample; };
 	
 	// Setter para Acelerometro
-	void setAccelData(int16_t ax, int16_t ay, int16_t az);
+	/* sampleTime: DW1000Timebase::now() when the sample was taken (0 = unknown). Every POLL carries the
+	   age of the sample, so the anchor places it on its own time base (DW1000Device::getImuTimestamp()). */
+	void setAccelData(int16_t ax, int16_t ay, int16_t az, int64_t sampleTime = 0);
 	
 private:
 	// Initialization
@@ -106,6 +206,7 @@ private:
 	static int16_t _global_ax;
     static int16_t _global_ay;
     static int16_t _global_az;
+	static int64_t _global_accelTime;
 	
 	// data buffer
 	static byte receivedData[LEN_DATA];
@@ -156,6 +257,8 @@ private:
 	static void (*_handleNewDevice)(DW1000Device *);
 	static void (*_handleInactiveDevice)(DW1000Device *);
 	static void (*_handleRemovedDeviceMaxReached)(DW1000Device *);
+	static void (*_handleLateTransmit)(DW1000Device *);
+	static void (*_handleTdoaSample)(const TdoaSample &);
 
 	// Board type (tag or anchor)
 	static BoardType _type;
@@ -164,8 +267,12 @@ private:
 	// Message sent/received state
 	static volatile boolean _sentAck;
 	static volatile boolean _receivedAck;
-	// Protocol error state
-	static boolean _protocolFailed;
+	static volatile boolean _receiveTimeoutAck;
+	// ANCHOR: a scheduled reply is pending (until about micros() _replyDueUs), another TX would cancel it
+	static boolean _replyPending;
+	static uint32_t _replyDueUs;
+	// ANCHOR: a RANGE is awaited after our POLL_ACK until about micros() _rangeDueUs
+	static uint32_t _rangeDueUs;
 	// Reset line to the chip
 	static uint8_t _RST;
 	static uint8_t _SS;
@@ -178,38 +285,74 @@ private:
 	static uint16_t _rangeInterval;
 	// Ranging counter (per second)
 	static uint32_t _rangingCountPeriod;
+	// Whether the IRQ wakes us up (see useTaskNotification)
+	static boolean _taskNotification;
+	// Whether the receiver uses both RX buffers (applied in receiver())
+	static boolean _doubleBuffering;
+	// Whether the tag asks for single-sided exchanges
+	static boolean _singleSided;
+	// TDOA: BLINKs only, and the SYNC period when we are the reference anchor (0 = not the reference)
+	static boolean _tdoa;
+	static uint16_t _tdoaSyncPeriod;
+	static uint32_t _tdoaLastSync;
+	// Whether the tag picks a PHY mode per anchor
+	static boolean _linkAdaptation;
+	// Drift compensation: sampling period (0 = off), linear model and the smoothed readings
+	static uint16_t _driftPeriod;
+	static uint32_t _driftLastSample;
+	static float _driftTicksPerDegree;
+	static float _driftReferenceTemp;
+	static float _temperature;
+	static float _voltage;
 
 	// Methods
 	static void handleSent();
 	static void handleReceived();
+	static void handleLateTransmit();
+	static void handleReceiveTimeout();
+	static boolean isReplyPending();
 	static void noteActivity();
 	static void resetInactive();
+	static void switchLinkMode(uint8_t code);
 
 	// Global functions:
 	static void checkForReset();
 	static void checkForInactiveDevices();
+	static uint32_t getTimeToNextDeadline();
 
 	// ANCHOR ranging protocol
 	static void transmitInit();
-	static void transmit(byte datas[]);
-	static void transmit(byte datas[], DW1000Time time);
+	static void transmit(byte datas[], uint16_t length);
+	static void transmit(byte datas[], uint16_t length, DW1000Duration delay);
 	static void transmitBlink();
 	static void transmitRangingInit(u_int16_t delay = 0);
-	static void transmitPollAck(DW1000Device *myDistantDevice, u_int16_t delay);
+	static void transmitPollAck(DW1000Device *myDistantDevice, u_int16_t delay, boolean withReplyTime = false);
 	static void transmitRangeReport(DW1000Device *myDistantDevice, u_int16_t delay);
 	static void transmitRangeFailed(DW1000Device *myDistantDevice);
+	static void transmitBeacon();
+	static void handleJoin(byte address[]);
+	static void sampleTempAndVbat();
+	static void transmitTdoaSync();
+	static void handleTdoaSync(byte address[], const RxDiagnostics &rxDiag);
+	static void handleTdoaBlink(const RxDiagnostics &rxDiag);
 	static void receiver();
 
 	// TAG ranging protocol
 	static void transmitPoll();
+	static void writePollImu(byte data[], int64_t pollTime);
 	static void transmitPollToAnchor(DW1000Device *targetAnchor);
 	static void transmitRange();
 	static void transmitRangeToAnchor(DW1000Device *targetAnchor);
 	static void advanceToNextAnchor();
+	static void pollCurrentAnchor();
+	static void expectResponse(uint32_t txDelay, uint16_t sentLength, uint16_t replyDelay, uint16_t responseLength, const byte responseMode[] = nullptr);
+	static void handleBeacon(byte coordinator[], const RxDiagnostics &rxDiag);
+	static void transmitJoin(byte coordinator[], DW1000Time time);
 
 	// Methods for range computation
 	static void timerTick();
 	static void computeRangeAsymmetric(DW1000Device *myDistantDevice, DW1000Time *myTOF);
+	static void computeRangeSingleSided(DW1000Device *myDistantDevice, const DW1000Time &replyTime, float clockOffset, DW1000Time *myTOF);
 	static uint16_t getReplyTimeOfIndex(int i);
 };
 
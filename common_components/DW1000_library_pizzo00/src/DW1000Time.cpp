@@ -124,7 +124,18 @@ void DW1000Time::setTime(int32_t value, float factorUs) {
 	//float tsValue = value*factorUs;
 	//tsValue = fmod(tsValue, TIME_OVERFLOW);
 	//setTime(tsValue);
-	setTime(value*factorUs);
+	// the usual factors are converted exactly, TIME_RES_INV is not representable as float
+	if(factorUs == MICROSECONDS) {
+		_timestamp = DW1000Duration::fromMicroseconds(value).getTicks();
+	} else if(factorUs == MILLISECONDS) {
+		_timestamp = DW1000Duration::fromMilliseconds(value).getTicks();
+	} else if(factorUs == SECONDS) {
+		_timestamp = DW1000Duration::fromSeconds(value).getTicks();
+	} else if(factorUs == NANOSECONDS) {
+		_timestamp = DW1000Duration::fromNanoseconds(value).getTicks();
+	} else {
+		_timestamp = (int64_t)(value*factorUs*TIME_RES_INV);
+	}
 }
 
 /**
@@ -174,6 +185,88 @@ float DW1000Time::getAsMeters() const {
 	return (_timestamp%TIME_OVERFLOW)*DISTANCE_OF_RADIO;
 }
 
+/**
+ * Return time as distance in millimeters, in integer arithmetic
+ * @return distance in millimeters
+ */
+int32_t DW1000Time::getAsMillimeters() const {
+	// DISTANCE_OF_RADIO in mm with 6 decimals, the product stays within 63 bits for 40 bit values
+	constexpr int64_t MILLIMETERS_PER_TICK_E6 = 4691764;
+	int64_t product = (_timestamp%TIME_OVERFLOW)*MILLIMETERS_PER_TICK_E6;
+	return (product + (product < 0 ? -500000 : 500000))/1000000;
+}
+
+// unsigned 128 bit value for the products of two 40 bit durations
+struct Product128 {
+	uint64_t hi;
+	uint64_t lo;
+};
+
+static Product128 multiply64(uint64_t a, uint64_t b) {
+	uint64_t aLo = a & 0xFFFFFFFF, aHi = a >> 32;
+	uint64_t bLo = b & 0xFFFFFFFF, bHi = b >> 32;
+	uint64_t lolo = aLo*bLo;
+	uint64_t middle1 = aHi*bLo;
+	uint64_t middle2 = aLo*bHi;
+	uint64_t carry = ((lolo >> 32) + (middle1 & 0xFFFFFFFF) + (middle2 & 0xFFFFFFFF)) >> 32;
+	Product128 result;
+	result.lo = lolo + (middle1 << 32) + (middle2 << 32);
+	result.hi = aHi*bHi + (middle1 >> 32) + (middle2 >> 32) + carry;
+	return result;
+}
+
+static bool isLess(const Product128& a, const Product128& b) {
+	return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+static Product128 subtract(const Product128& a, const Product128& b) {
+	Product128 result;
+	result.lo = a.lo - b.lo;
+	result.hi = a.hi - b.hi - (a.lo < b.lo ? 1 : 0);
+	return result;
+}
+
+// a / divisor for a divisor below 2^62 (the remainder never needs more than 63 bits)
+static uint64_t divide(const Product128& a, uint64_t divisor) {
+	uint64_t quotient = 0;
+	uint64_t remainder = 0;
+	for(int8_t bit = 127; bit >= 0; bit--) {
+		uint64_t next = bit >= 64 ? (a.hi >> (bit - 64)) & 1 : (a.lo >> bit) & 1;
+		remainder = (remainder << 1) | next;
+		quotient <<= 1;
+		if(remainder >= divisor) {
+			remainder -= divisor;
+			quotient |= 1;
+		}
+	}
+	return quotient;
+}
+
+/**
+ * Time of flight of an asymmetric double-sided two-way ranging exchange, without floating point
+ * and without overflow: the durations are taken modulo 2^40 (differences of timestamps).
+ * @return time of flight in ticks, negative for inconsistent durations, 0 if they are all 0
+ */
+int64_t DW1000Time::asymmetricTimeOfFlight(int64_t round1, int64_t reply1, int64_t round2, int64_t reply2) {
+	uint64_t r1 = round1 & TIME_MAX, d1 = reply1 & TIME_MAX;
+	uint64_t r2 = round2 & TIME_MAX, d2 = reply2 & TIME_MAX;
+	uint64_t sum = r1 + d1 + r2 + d2;
+	if(sum == 0) {
+		return 0;
+	}
+	// usual exchanges (durations below ~33 ms): the products fit in 63 bits
+	constexpr uint64_t SMALL = (uint64_t)1 << 31;
+	if(r1 < SMALL && d1 < SMALL && r2 < SMALL && d2 < SMALL) {
+		return ((int64_t)(r1*r2) - (int64_t)(d1*d2))/(int64_t)sum;
+	}
+	Product128 rounds = multiply64(r1, r2);
+	Product128 replies = multiply64(d1, d2);
+	if(isLess(rounds, replies)) {
+		return -(int64_t)divide(subtract(replies, rounds), sum);
+	}
+	return (int64_t)divide(subtract(rounds, replies), sum);
+}
+
 /**
  * Converts negative values due overflow of one node to correct value
  * @example:
@@ -228,6 +321,25 @@ DW1000Time DW1000Time::operator-(const DW1000Time& sub) const {
 	return DW1000Time(*this) -= sub;
 }
 
+// shift by a duration
+DW1000Time& DW1000Time::operator+=(const DW1000Duration& add) {
+	_timestamp += add.getTicks();
+	return *this;
+}
+
+DW1000Time DW1000Time::operator+(const DW1000Duration& add) const {
+	return DW1000Time(*this) += add;
+}
+
+DW1000Time& DW1000Time::operator-=(const DW1000Duration& sub) {
+	_timestamp -= sub.getTicks();
+	return *this;
+}
+
+DW1000Time DW1000Time::operator-(const DW1000Duration& sub) const {
+	return DW1000Time(*this) -= sub;
+}
+
 // multiply
 DW1000Time& DW1000Time::operator*=(float factor) {
 	//float tsValue = (float)_timestamp*factor;
@@ -21,6 +21,7 @@
  * 
  * @TODO
  * - avoid/remove floating operations, expensive on most microprocessors
+ *   (done for delays: use DW1000Duration, the float constructors are deprecated)
  * 
  * @note
  * comments in cpp file, makes .h smaller and gives a better overview about
@@ -38,6 +39,46 @@
 #include "require_cpp11.h"
 
 
+/**
+ * A duration in DW1000 ticks (approx. 15.65ps), as opposed to an absolute 40 bit timestamp.
+ * Built with exact integer conversions: the counter runs at 128 * 499.2 MHz, so
+ * one micro second is exactly 63897.6 = 319488 / 5 ticks.
+ */
+class DW1000Duration {
+public:
+	static constexpr int64_t TICKS_PER_US_NUM = 319488;
+	static constexpr int64_t TICKS_PER_US_DEN = 5;
+	
+	constexpr explicit DW1000Duration(int64_t ticks = 0) : _ticks(ticks) {}
+	
+	// conversions from usual units, truncated to whole ticks
+	static constexpr DW1000Duration fromSeconds(int64_t value) {
+		return DW1000Duration(value*1000000*TICKS_PER_US_NUM/TICKS_PER_US_DEN);
+	}
+	static constexpr DW1000Duration fromMilliseconds(int64_t value) {
+		return DW1000Duration(value*1000*TICKS_PER_US_NUM/TICKS_PER_US_DEN);
+	}
+	static constexpr DW1000Duration fromMicroseconds(int64_t value) {
+		return DW1000Duration(value*TICKS_PER_US_NUM/TICKS_PER_US_DEN);
+	}
+	static constexpr DW1000Duration fromNanoseconds(int64_t value) {
+		return DW1000Duration(value*TICKS_PER_US_NUM/(TICKS_PER_US_DEN*1000));
+	}
+	
+	constexpr int64_t getTicks() const { return _ticks; }
+	constexpr int64_t getAsMicroSeconds() const { return _ticks*TICKS_PER_US_DEN/TICKS_PER_US_NUM; }
+	
+	constexpr DW1000Duration operator+(const DW1000Duration& add) const { return DW1000Duration(_ticks + add._ticks); }
+	constexpr DW1000Duration operator-(const DW1000Duration& sub) const { return DW1000Duration(_ticks - sub._ticks); }
+	constexpr DW1000Duration operator*(int32_t factor) const { return DW1000Duration(_ticks*factor); }
+	constexpr DW1000Duration operator/(int32_t divisor) const { return DW1000Duration(_ticks/divisor); }
+	
+private:
+	int64_t _ticks;
+};
+
+static_assert(DW1000Duration::fromMilliseconds(1).getTicks() == 63897600, "DW1000 tick rate");
+
 class DW1000Time {
 public:
 	// Time resolution in micro-seconds of time based registers/values.
@@ -57,7 +98,7 @@ public:
 	static constexpr int64_t TIME_MAX      = 0xffffffffff;
 	
 	// time factors (relative to [us]) for setting delayed transceive
-	// TODO use non float
+	// use the integer DW1000Duration::from*() instead
 	static constexpr float SECONDS      = 1e6;
 	static constexpr float MILLISECONDS = 1e3;
 	static constexpr float MICROSECONDS = 1;
@@ -68,7 +109,9 @@ public:
 	DW1000Time(int64_t time);
 	DW1000Time(byte data[]);
 	DW1000Time(const DW1000Time& copy);
+	DEPRECATED_MSG("use DW1000Duration::fromMicroseconds()")
 	DW1000Time(float timeUs);
+	DEPRECATED_MSG("use DW1000Duration::from*()")
 	DW1000Time(int32_t value, float factorUs);
 	~DW1000Time();
 	
@@ -92,6 +135,12 @@ public:
 	float getAsMicroSeconds() const;
 	//void getAsBytes(byte data[]) const; // TODO check why it is here, is it old version of getTimestamp(byte) ?
 	float getAsMeters() const;
+	// the same in fixed point, millimeters (integer only)
+	int32_t getAsMillimeters() const;
+	
+	// asymmetric double-sided two-way ranging: (round1 * round2 - reply1 * reply2) / (sum of all four),
+	// exact for any 40 bit durations (their products need up to 80 bits), truncated to whole ticks
+	static int64_t asymmetricTimeOfFlight(int64_t round1, int64_t reply1, int64_t round2, int64_t reply2);
 	
 	DW1000Time& wrap();
 	
@@ -106,8 +155,14 @@ public:
 	// subtract
 	DW1000Time& operator-=(const DW1000Time& sub);
 	DW1000Time operator-(const DW1000Time& sub) const;
+	// timestamp shifted by a duration, integer only
+	DW1000Time& operator+=(const DW1000Duration& add);
+	DW1000Time operator+(const DW1000Duration& add) const;
+	DW1000Time& operator-=(const DW1000Duration& sub);
+	DW1000Time operator-(const DW1000Duration& sub) const;
 	// multiply
 	// multiply with float cause lost in accuracy, because float calculates only with 23bit matise
+	// (not used for ranging anymore, delays are DW1000Duration)
 	DW1000Time& operator*=(float factor);
 	DW1000Time operator*(float factor) const;
 	// no accuracy lost
@@ -0,0 +1,144 @@
+/*
+ * Decawave DW1000 library for arduino.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file DW1000Timebase.cpp
+ * Extended 64 bit timebase of the DW1000 system clock (source file).
+ */
+
+#include "DW1000Timebase.h"
+#include "DW1000.h"
+#include <esp_timer.h>
+
+int64_t DW1000Timebase::_syncTicks = 0;
+int64_t DW1000Timebase::_syncHostUs = 0;
+boolean DW1000Timebase::_synchronized = false;
+
+// update() runs on the core of the DW1000 task, now() on any core
+static portMUX_TYPE g_timebaseLock = portMUX_INITIALIZER_UNLOCKED;
+// last value returned by now(), it never goes back when a synchronization corrects the drift
+static int64_t g_timebaseLastNow = 0;
+
+/**
+ * Reads the DW1000 system time and takes the rollovers since the last call into account.
+ * Between two calls the esp_timer tells how many ticks have passed, so a call may come
+ * later than one wrap period (the crystals differ by some ppm only).
+ * @param force read even if the last synchronization is recent
+ */
+void DW1000Timebase::update(boolean force) {
+	int64_t hostUs = esp_timer_get_time();
+	portENTER_CRITICAL(&g_timebaseLock);
+	boolean due = force || !_synchronized || hostUs - _syncHostUs >= UPDATE_PERIOD_US;
+	portEXIT_CRITICAL(&g_timebaseLock);
+	if(!due) {
+		return;
+	}
+	// the SPI read takes some us, the host time of its middle matches best
+	DW1000Time systemTime;
+	int64_t before = esp_timer_get_time();
+	DW1000.getSystemTimestamp(systemTime);
+	int64_t after = esp_timer_get_time();
+	hostUs = before + (after - before)/2;
+
+	portENTER_CRITICAL(&g_timebaseLock);
+	if(_synchronized) {
+		int64_t expected = _syncTicks + DW1000Duration::fromMicroseconds(hostUs - _syncHostUs).getTicks();
+		_syncTicks = closestTo(expected, systemTime.getTimestamp());
+	} else {
+		_syncTicks = systemTime.getTimestamp() & DW1000Time::TIME_MAX;
+		g_timebaseLastNow = 0;
+	}
+	_syncHostUs = hostUs;
+	_synchronized = true;
+	portEXIT_CRITICAL(&g_timebaseLock);
+}
+
+/**
+ * Forgets the synchronization, the next update() starts a new base
+ */
+void DW1000Timebase::reset() {
+	portENTER_CRITICAL(&g_timebaseLock);
+	_synchronized = false;
+	portEXIT_CRITICAL(&g_timebaseLock);
+}
+
+/**
+ * @return true once update() has read the DW1000 system time
+ */
+boolean DW1000Timebase::isSynchronized() {
+	return _synchronized;
+}
+
+/**
+ * Converts a 40 bit timestamp of the DW1000 (RX/TX timestamp) to the extended base.
+ * @param timestamp timestamp of a recent event, +-8.6 s around now
+ * @return 64 bit ticks, the timestamp itself if not synchronized yet
+ */
+int64_t DW1000Timebase::extend(const DW1000Time& timestamp) {
+	int64_t hostUs = esp_timer_get_time();
+	portENTER_CRITICAL(&g_timebaseLock);
+	int64_t result = timestamp.getTimestamp() & DW1000Time::TIME_MAX;
+	if(_synchronized) {
+		int64_t expected = _syncTicks + DW1000Duration::fromMicroseconds(hostUs - _syncHostUs).getTicks();
+		result = closestTo(expected, result);
+	}
+	portEXIT_CRITICAL(&g_timebaseLock);
+	return result;
+}
+
+/**
+ * Current time on the extended base, from the esp_timer since the last synchronization
+ * (the drift between the crystals stays in the order of some 10 us per UPDATE_PERIOD_US).
+ * @return 64 bit ticks, monotonic; 0 if not synchronized yet
+ */
+int64_t DW1000Timebase::now() {
+	int64_t hostUs = esp_timer_get_time();
+	portENTER_CRITICAL(&g_timebaseLock);
+	int64_t result = 0;
+	if(_synchronized) {
+		result = _syncTicks + DW1000Duration::fromMicroseconds(hostUs - _syncHostUs).getTicks();
+		if(result < g_timebaseLastNow) {
+			result = g_timebaseLastNow;
+		}
+		g_timebaseLastNow = result;
+	}
+	portEXIT_CRITICAL(&g_timebaseLock);
+	return result;
+}
+
+/**
+ * @param ticks 64 bit ticks of the extended base
+ * @return the same in micro seconds, truncated
+ */
+int64_t DW1000Timebase::toMicroseconds(int64_t ticks) {
+	// split, ticks * 5 overflows after some months
+	int64_t whole = ticks/DW1000Duration::TICKS_PER_US_NUM;
+	int64_t rest = ticks%DW1000Duration::TICKS_PER_US_NUM;
+	return whole*DW1000Duration::TICKS_PER_US_DEN + rest*DW1000Duration::TICKS_PER_US_DEN/DW1000Duration::TICKS_PER_US_NUM;
+}
+
+/**
+ * @param reference 64 bit ticks near the searched value
+ * @param timestamp 40 bit timestamp
+ * @return the 64 bit value with the low 40 bits of timestamp closest to reference
+ */
+int64_t DW1000Timebase::closestTo(int64_t reference, int64_t timestamp) {
+	int64_t result = (reference & ~DW1000Time::TIME_MAX) | (timestamp & DW1000Time::TIME_MAX);
+	if(result - reference > DW1000Time::TIME_OVERFLOW/2) {
+		result -= DW1000Time::TIME_OVERFLOW;
+	} else if(reference - result > DW1000Time::TIME_OVERFLOW/2) {
+		result += DW1000Time::TIME_OVERFLOW;
+	}
+	return result;
+}
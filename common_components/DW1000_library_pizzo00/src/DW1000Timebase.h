@@ -0,0 +1,60 @@
+/*
+ * Decawave DW1000 library for arduino.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file DW1000Timebase.h
+ * Extended 64 bit timebase of the DW1000 system clock (header file).
+ *
+ * The 40 bit counter of the DW1000 wraps approx. every 17.2 seconds. The timebase
+ * follows the rollovers by reading the system time periodically (update(), from the task
+ * that owns the DW1000) and correlating it with esp_timer_get_time(), so that
+ * - any RX/TX timestamp becomes a monotonic 64 bit value (extend())
+ * - any task, also on the other core and without SPI access, can read the current time
+ *   on the same base (now()), e.g. to timestamp IMU samples
+ */
+
+#ifndef DW1000TIMEBASE_H
+#define DW1000TIMEBASE_H
+
+#include <Arduino.h>
+#include "DW1000Time.h"
+
+class DW1000Timebase {
+public:
+	// read the DW1000 system time at most every UPDATE_PERIOD_US (well below the 17.2 s wrap)
+	static constexpr int64_t UPDATE_PERIOD_US = 1000000;
+
+	// resynchronizes with the DW1000 system time (SPI access, call from the task owning the DW1000)
+	static void update(boolean force = false);
+	// start again after a reset of the DW1000 (its counter restarts from 0)
+	static void reset();
+	static boolean isSynchronized();
+
+	// 40 bit timestamp of the DW1000 as 64 bit ticks, a valid result within +-8.6 s of the last update()
+	static int64_t extend(const DW1000Time& timestamp);
+	// current time in 64 bit ticks, from esp_timer (no SPI access, any task)
+	static int64_t now();
+	// 64 bit ticks to micro seconds (without overflow)
+	static int64_t toMicroseconds(int64_t ticks);
+
+private:
+	static int64_t closestTo(int64_t reference, int64_t timestamp);
+
+	// last synchronization: DW1000 time (64 bit) and esp_timer time at the same moment
+	static int64_t _syncTicks;
+	static int64_t _syncHostUs;
+	static boolean _synchronized;
+};
+
+#endif
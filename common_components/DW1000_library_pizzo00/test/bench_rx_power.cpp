@@ -0,0 +1,55 @@
+/*
+ * Microbenchmark of the power estimation: the fixed point path of the
+ * library against the float log10 formula it replaces. Host timings only
+ * show the relative cost, the ESP32 has no double precision FPU and a
+ * slower float log10.
+ */
+
+#include <chrono>
+#include "DW1000.h"
+#include "test.h"
+
+static const uint32_t SAMPLES = 4096;
+static const uint32_t ROUNDS = 500;
+
+// the float formula of DW1000_FIXED_POINT_RX_POWER 0
+static float floatReceivePower(uint16_t C, uint16_t N)
+{
+	float estRxPwr = 10.0 * log10(((float)C * 131072.0f) / ((float)N * (float)N)) - 113.77f;
+	if (estRxPwr > -88)
+	{
+		estRxPwr += (estRxPwr + 88) * 2.3334f;
+	}
+	return estRxPwr;
+}
+
+template <typename F>
+static double nanosecondsPerCall(const uint16_t C[], const uint16_t N[], F function)
+{
+	volatile float sink = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t round = 0; round < ROUNDS; round++)
+	{
+		for (uint32_t i = 0; i < SAMPLES; i++)
+		{
+			sink = sink + function(C[i], N[i]);
+		}
+	}
+	auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+	return (double)elapsed.count() / (SAMPLES * ROUNDS);
+}
+
+int main()
+{
+	static uint16_t C[SAMPLES], N[SAMPLES];
+	for (uint32_t i = 0; i < SAMPLES; i++)
+	{
+		C[i] = testRandom() % 65535 + 1;
+		N[i] = testRandom() % 4095 + 1;
+	}
+	DW1000Class::_pulseFrequency = DW1000Class::TX_PULSE_FREQ_16MHZ;
+	double fixed = nanosecondsPerCall(C, N, DW1000Class::computeReceivePower);
+	double floating = nanosecondsPerCall(C, N, floatReceivePower);
+	printf("computeReceivePower: fixed point %.1f ns, float %.1f ns per call\n", fixed, floating);
+	return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * Microbenchmark of asymmetricTimeOfFlight(): the 63 bit fast path (usual
+ * exchanges) and the 128 bit multiply with bit-serial divide (durations
+ * from 2^31 ticks on), against the double formula it replaces. Host timings
+ * only show the relative cost, the ESP32 has no double precision FPU.
+ */
+
+#include <chrono>
+#include "DW1000Time.h"
+#include "test.h"
+
+static const uint32_t SAMPLES = 4096;
+static const uint32_t ROUNDS = 200;
+
+// the double version of the formula, before the integer one
+static int64_t doubleTimeOfFlight(int64_t round1, int64_t reply1, int64_t round2, int64_t reply2)
+{
+	double r1 = round1, d1 = reply1, r2 = round2, d2 = reply2;
+	return (int64_t)((r1 * r2 - d1 * d2) / (r1 + d1 + r2 + d2));
+}
+
+template <typename F>
+static double nanosecondsPerCall(const int64_t durations[][4], F function)
+{
+	volatile int64_t sink = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t round = 0; round < ROUNDS; round++)
+	{
+		for (uint32_t i = 0; i < SAMPLES; i++)
+		{
+			sink = sink + function(durations[i][0], durations[i][1], durations[i][2], durations[i][3]);
+		}
+	}
+	auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+	return (double)elapsed.count() / (SAMPLES * ROUNDS);
+}
+
+// an exchange with replies below maxReply ticks and a time of flight up to ~300 m
+static void randomExchanges(int64_t durations[][4], int64_t minReply, int64_t maxReply)
+{
+	for (uint32_t i = 0; i < SAMPLES; i++)
+	{
+		int64_t tof = testRandom() % 64000;
+		int64_t reply1 = minReply + testRandom() % (maxReply - minReply);
+		int64_t reply2 = minReply + testRandom() % (maxReply - minReply);
+		durations[i][0] = reply1 + 2 * tof;
+		durations[i][1] = reply1;
+		durations[i][2] = reply2 + 2 * tof;
+		durations[i][3] = reply2;
+	}
+}
+
+static void bench(const char *name, const int64_t durations[][4])
+{
+	double integer = nanosecondsPerCall(durations, DW1000Time::asymmetricTimeOfFlight);
+	double floating = nanosecondsPerCall(durations, doubleTimeOfFlight);
+	printf("asymmetricTimeOfFlight %s: integer %.1f ns, double %.1f ns per call\n", name, integer, floating);
+}
+
+int main()
+{
+	static int64_t durations[SAMPLES][4];
+	const int64_t SMALL = (int64_t)1 << 31;
+	// replies of 0.3 to 10 ms
+	randomExchanges(durations, DW1000Duration::fromMicroseconds(300).getTicks(),
+					DW1000Duration::fromMicroseconds(10000).getTicks());
+	bench("63 bit", durations);
+	// replies from 2^31 ticks (~34 ms) to half the 40 bit range
+	randomExchanges(durations, SMALL, DW1000Time::TIME_MAX / 2);
+	bench("128 bit", durations);
+	return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * Minimal Arduino core for the host tests of the library (test/Makefile):
+ * only the types and functions the library sources use, no hardware.
+ */
+
+#ifndef ARDUINO_STUB_H
+#define ARDUINO_STUB_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define IRAM_ATTR
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define RISING 1
+#define MSBFIRST 1
+#define SPI_MODE0 0
+
+#define bitRead(value, bit) (((value) >> (bit)) & 1)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+
+// only what DW1000Class::setData()/getData() use
+class String
+{
+public:
+	String(const char *value = "") {}
+	unsigned int length() const { return 0; }
+	void getBytes(unsigned char *buffer, unsigned int size) const {}
+	void remove(unsigned int index) {}
+	String &operator+=(char c) { return *this; }
+};
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int digitalPinToInterrupt(int pin);
+void attachInterrupt(int interrupt, void (*handler)(void), int mode);
+long random(long low, long high);
+
+#endif
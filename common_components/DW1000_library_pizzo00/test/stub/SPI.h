@@ -0,0 +1,44 @@
+/*
+ * SPI of the ESP32 Arduino core for the host tests, the transfers go to
+ * spiDevice when a test attaches one (stub/stub.cpp).
+ */
+
+#ifndef SPI_STUB_H
+#define SPI_STUB_H
+
+#include <Arduino.h>
+
+class SPISettings
+{
+public:
+	SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {}
+};
+
+class SPIClass
+{
+public:
+	void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1) {}
+	void beginTransaction(SPISettings settings) {}
+	void endTransaction() {}
+	void transferBytes(const uint8_t *data, uint8_t *out, uint32_t size);
+	void writeBytes(const uint8_t *data, uint32_t size);
+};
+
+extern SPIClass SPI;
+
+// host tests: the device behind the bus, selected by digitalWrite(chipSelect, LOW)
+class SPIDevice
+{
+public:
+	SPIDevice(uint8_t chipSelect) : chipSelect(chipSelect) {}
+	virtual ~SPIDevice() {}
+	virtual void select(bool selected) = 0;
+	// one call of transferBytes()/writeBytes(), out is nullptr for writeBytes()
+	virtual void transfer(const uint8_t *data, uint8_t *out, uint32_t size) = 0;
+
+	const uint8_t chipSelect;
+};
+
+extern SPIDevice *spiDevice;
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ * FreeRTOS types for the host tests, single threaded.
+ */
+
+#ifndef FREERTOS_STUB_H
+#define FREERTOS_STUB_H
+
+#include <stdint.h>
+
+typedef void *TaskHandle_t;
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portMAX_DELAY 0xFFFFFFFFu
+#define portYIELD_FROM_ISR(woken) (void)(woken)
+
+typedef struct
+{
+	int owner;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(mux) (void)(mux)
+#define portEXIT_CRITICAL(mux) (void)(mux)
+
+#endif
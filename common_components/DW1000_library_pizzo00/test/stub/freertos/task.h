@@ -0,0 +1,12 @@
+#ifndef FREERTOS_TASK_STUB_H
+#define FREERTOS_TASK_STUB_H
+
+#include "FreeRTOS.h"
+
+inline void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {}
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task) { return pdTRUE; }
+inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) { return 0; }
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return nullptr; }
+inline void vTaskDelay(TickType_t ticks) {}
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * Host implementations of the Arduino functions declared in the stubs.
+ */
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <chrono>
+
+static const auto startTime = std::chrono::steady_clock::now();
+
+unsigned long micros()
+{
+	return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long millis()
+{
+	return micros() / 1000;
+}
+
+void delay(unsigned long ms) {}
+void delayMicroseconds(unsigned int us) {}
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+	if (spiDevice != nullptr && pin == spiDevice->chipSelect)
+	{
+		spiDevice->select(value == LOW);
+	}
+}
+int digitalRead(uint8_t pin) { return HIGH; }
+int digitalPinToInterrupt(int pin) { return pin; }
+void attachInterrupt(int interrupt, void (*handler)(void), int mode) {}
+long random(long low, long high) { return low + rand() % (high - low); }
+
+SPIClass SPI;
+SPIDevice *spiDevice = nullptr;
+
+void SPIClass::transferBytes(const uint8_t *data, uint8_t *out, uint32_t size)
+{
+	if (spiDevice != nullptr)
+	{
+		spiDevice->transfer(data, out, size);
+	}
+	else if (out != nullptr)
+	{
+		memset(out, 0, size);
+	}
+}
+
+void SPIClass::writeBytes(const uint8_t *data, uint32_t size)
+{
+	if (spiDevice != nullptr)
+	{
+		spiDevice->transfer(data, nullptr, size);
+	}
+}
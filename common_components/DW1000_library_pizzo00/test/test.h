@@ -0,0 +1,40 @@
+/*
+ * Checks for the host tests: CHECK() counts and reports failures, main()
+ * returns TEST_RESULT() so make stops at the first failing test.
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+[[maybe_unused]] static unsigned testFailures = 0;
+
+#define CHECK(condition, ...)                                         \
+	do                                                                \
+	{                                                                 \
+		if (!(condition))                                             \
+		{                                                             \
+			if (testFailures++ < 20)                                  \
+			{                                                         \
+				printf("%s:%d: %s: ", __FILE__, __LINE__, #condition); \
+				printf(__VA_ARGS__);                                  \
+				printf("\n");                                         \
+			}                                                         \
+		}                                                             \
+	} while (0)
+
+#define TEST_RESULT() (printf("%s: %s (%u failures)\n", __FILE__, testFailures == 0 ? "OK" : "FAILED", testFailures), testFailures != 0)
+
+// xorshift64, the same sequence on every run
+[[maybe_unused]] static uint64_t testRandom()
+{
+	static uint64_t state = 0x9E3779B97F4A7C15ULL;
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+#endif
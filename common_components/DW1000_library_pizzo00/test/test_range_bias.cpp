@@ -0,0 +1,78 @@
+/*
+ * Range bias correction from the precomputed tables against the float
+ * interpolation it replaces: within 1 tick from -40 to -110 dBm on the
+ * four tables (500/900 MHz band, 16/64 MHz PRF), table picked by tune(),
+ * also for a reserved PRF code.
+ */
+
+#include "DW1000.h"
+#include "test.h"
+
+// the float version of correctTimestamp() the tables replace, as a correction in ticks
+static int16_t referenceCorrection(float rxPower, const byte bias[], byte zero, int16_t mmPerUnit)
+{
+	float rxPowerBase = -(rxPower + 61.0f) * 0.5f;
+	int16_t rxPowerBaseLow = (int16_t)rxPowerBase;
+	int16_t rxPowerBaseHigh = rxPowerBaseLow + 1;
+	if (rxPowerBaseLow <= 0)
+	{
+		rxPowerBaseLow = 0;
+		rxPowerBaseHigh = 0;
+	}
+	else if (rxPowerBaseHigh >= 17)
+	{
+		rxPowerBaseLow = 17;
+		rxPowerBaseHigh = 17;
+	}
+	int16_t rangeBiasHigh = (rxPowerBaseHigh < zero ? -bias[rxPowerBaseHigh] : bias[rxPowerBaseHigh]) * mmPerUnit;
+	int16_t rangeBiasLow = (rxPowerBaseLow < zero ? -bias[rxPowerBaseLow] : bias[rxPowerBaseLow]) * mmPerUnit;
+	float rangeBias = rangeBiasLow + (rxPowerBase - rxPowerBaseLow) * (rangeBiasHigh - rangeBiasLow);
+	return (int16_t)(rangeBias * DW1000Time::DISTANCE_OF_RADIO_INV * 0.001f);
+}
+
+static void testTable(byte channel, byte prf, const byte bias[], byte zero, int16_t mmPerUnit, const char *name)
+{
+	DW1000Class::_channel = channel;
+	DW1000Class::_pulseFrequency = prf;
+	DW1000Class::tune();
+
+	const int64_t base = 1000000;
+	int32_t maxDifference = 0;
+	for (int32_t milliDbm = -40000; milliDbm >= -110000; milliDbm--)
+	{
+		float rxPower = milliDbm / 1000.0f;
+		DW1000Time timestamp(base);
+		DW1000Class::correctTimestamp(timestamp, rxPower);
+		int32_t difference = abs((int32_t)(base - timestamp.getTimestamp()) - referenceCorrection(rxPower, bias, zero, mmPerUnit));
+		maxDifference = difference > maxDifference ? difference : maxDifference;
+		CHECK(difference <= 1, "%s at %.3f dBm: %lld ticks, float %d", name, rxPower,
+			  (long long)(base - timestamp.getTimestamp()), referenceCorrection(rxPower, bias, zero, mmPerUnit));
+	}
+	printf("%s: max difference %d tick\n", name, maxDifference);
+
+	// an empty accumulator gives -inf dBm: the last entry, like the weakest signal
+	DW1000Time empty(base), weakest(base);
+	DW1000Class::correctTimestamp(empty, -INFINITY);
+	DW1000Class::correctTimestamp(weakest, -110.0f);
+	CHECK(empty.getTimestamp() == weakest.getTimestamp(), "%s at -inf dBm", name);
+}
+
+int main()
+{
+	testTable(DW1000Class::CHANNEL_5, DW1000Class::TX_PULSE_FREQ_16MHZ, DW1000Class::BIAS_500_16, DW1000Class::BIAS_500_16_ZERO, 1, "500 MHz PRF16");
+	testTable(DW1000Class::CHANNEL_5, DW1000Class::TX_PULSE_FREQ_64MHZ, DW1000Class::BIAS_500_64, DW1000Class::BIAS_500_64_ZERO, 1, "500 MHz PRF64");
+	testTable(DW1000Class::CHANNEL_7, DW1000Class::TX_PULSE_FREQ_16MHZ, DW1000Class::BIAS_900_16, DW1000Class::BIAS_900_16_ZERO, 2, "900 MHz PRF16");
+	testTable(DW1000Class::CHANNEL_4, DW1000Class::TX_PULSE_FREQ_64MHZ, DW1000Class::BIAS_900_64, DW1000Class::BIAS_900_64_ZERO, 2, "900 MHz PRF64");
+
+	// a reserved PRF code still gets a table, the 16 MHz one of the band
+	DW1000Class::_channel = DW1000Class::CHANNEL_5;
+	DW1000Class::_pulseFrequency = 0;
+	DW1000Class::tune();
+	const int64_t base = 1000000;
+	DW1000Time reserved(base);
+	DW1000Class::correctTimestamp(reserved, -80.0f);
+	int32_t correction = (int32_t)(base - reserved.getTimestamp());
+	CHECK(abs(correction - referenceCorrection(-80.0f, DW1000Class::BIAS_500_16, DW1000Class::BIAS_500_16_ZERO, 1)) <= 1,
+		  "reserved PRF: %d ticks", correction);
+	return TEST_RESULT();
+}
@@ -0,0 +1,85 @@
+/*
+ * Fixed point power estimation (DW1000_FIXED_POINT_RX_POWER) against the
+ * float formula of the user manual, section 4.7: log2Q16() over the whole
+ * input range and computeReceivePower()/computeFirstPathPower() over the
+ * register ranges, for both PRFs.
+ */
+
+#include "DW1000.h"
+#include "test.h"
+
+// user manual section 4.7, including the correction of Fig. 22
+static double referencePower(double ratio)
+{
+	bool prf16 = DW1000Class::_pulseFrequency == DW1000Class::TX_PULSE_FREQ_16MHZ;
+	double A = prf16 ? 113.77 : 121.74;
+	double corrFac = prf16 ? 2.3334 : 1.1667;
+	double power = 10.0 * log10(ratio) - A;
+	if (power > -88)
+	{
+		power += (power + 88) * corrFac;
+	}
+	return power;
+}
+
+static void testLog2()
+{
+	double maxError = 0;
+	for (uint8_t shift = 0; shift < 48; shift++)
+	{
+		for (uint32_t i = 0; i < 20000; i++)
+		{
+			uint64_t value = (testRandom() >> (63 - shift)) | ((uint64_t)1 << shift);
+			double error = fabs(DW1000Class::log2Q16(value) / 65536.0 - log2((double)value));
+			maxError = error > maxError ? error : maxError;
+		}
+		uint64_t power = (uint64_t)1 << shift;
+		CHECK(DW1000Class::log2Q16(power) == (int32_t)shift << 16, "log2(2^%d)", shift);
+	}
+	// table interpolation and rounding, about 1/5000 of an octave (6e-4 dB)
+	CHECK(maxError < 2.5e-4, "log2 max error %.6f", maxError);
+	printf("log2Q16: max error %.6f\n", maxError);
+}
+
+static void testPower(byte prf, const char *name)
+{
+	DW1000Class::_pulseFrequency = prf;
+	double rxMax = 0, rxSum = 0, fpMax = 0;
+	uint32_t count = 0;
+	for (uint32_t C = 1; C <= 65535; C += 7)
+	{
+		for (uint16_t N = 1; N <= 4095; N += 13)
+		{
+			double error = fabs(DW1000Class::computeReceivePower(C, N) - referencePower(C * 131072.0 / ((double)N * N)));
+			rxMax = error > rxMax ? error : rxMax;
+			rxSum += error;
+			count++;
+		}
+	}
+	for (uint32_t i = 0; i < 1000000; i++)
+	{
+		uint16_t f1 = testRandom(), f2 = testRandom(), f3 = testRandom();
+		uint16_t N = testRandom() % 4095 + 1;
+		if (f1 == 0 && f2 == 0 && f3 == 0)
+		{
+			continue;
+		}
+		double ampl = (double)f1 * f1 + (double)f2 * f2 + (double)f3 * f3;
+		double error = fabs(DW1000Class::computeFirstPathPower(f1, f2, f3, N) - referencePower(ampl / ((double)N * N)));
+		fpMax = error > fpMax ? error : fpMax;
+	}
+	CHECK(rxMax < 0.02, "%s rx max error %.4f dB", name, rxMax);
+	CHECK(fpMax < 0.02, "%s fp max error %.4f dB", name, fpMax);
+	CHECK(isinf(DW1000Class::computeReceivePower(0, 100)) && isinf(DW1000Class::computeReceivePower(100, 0)),
+		  "%s empty accumulator", name);
+	CHECK(isinf(DW1000Class::computeFirstPathPower(0, 0, 0, 100)), "%s no first path", name);
+	printf("%s: rx max %.4f dB, mean %.4f dB; fp max %.4f dB\n", name, rxMax, rxSum / count, fpMax);
+}
+
+int main()
+{
+	testLog2();
+	testPower(DW1000Class::TX_PULSE_FREQ_16MHZ, "PRF16");
+	testPower(DW1000Class::TX_PULSE_FREQ_64MHZ, "PRF64");
+	return TEST_RESULT();
+}
@@ -0,0 +1,174 @@
+/*
+ * Burst register access of readBytes()/writeBytes() against a model of the
+ * DW1000 SPI protocol (user manual, section 2.2.1): every header form, and
+ * lengths around the 64 byte burst, with one chip select per access, no
+ * burst longer than the FIFO and word-aligned buffers.
+ */
+
+#include "DW1000.h"
+#include "test.h"
+
+class RegisterModel : public SPIDevice
+{
+public:
+	static const uint16_t REGISTER_SIZE = 0x8000; // 15 bit sub-address
+
+	RegisterModel(uint8_t chipSelect) : SPIDevice(chipSelect) {}
+
+	void select(bool selected) override
+	{
+		if (selected)
+		{
+			selects++;
+			bursts = 0;
+			headerLength = 0;
+			expectedHeader = 1;
+		}
+		_selected = selected;
+	}
+
+	void transfer(const uint8_t *data, uint8_t *out, uint32_t size) override
+	{
+		bursts++;
+		maxBurst = size > maxBurst ? size : maxBurst;
+		misaligned |= ((uintptr_t)data & 3) != 0 || ((uintptr_t)out & 3) != 0;
+		unselected |= !_selected;
+		for (uint32_t i = 0; i < size; i++)
+		{
+			// nullptr: the ESP32 HAL clocks out 0xFF
+			uint8_t mosi = data != nullptr ? data[i] : 0xFF;
+			uint8_t miso = exchange(mosi);
+			if (out != nullptr)
+			{
+				out[i] = miso;
+			}
+		}
+	}
+
+	uint8_t registers[64][REGISTER_SIZE];
+	uint32_t selects = 0;
+	uint32_t bursts = 0;
+	uint32_t maxBurst = 0;
+	bool misaligned = false;
+	bool unselected = false;
+
+private:
+	uint8_t exchange(uint8_t mosi)
+	{
+		if (headerLength < expectedHeader)
+		{
+			header[headerLength++] = mosi;
+			if (headerLength == 1 && (mosi & 0x40))
+			{
+				expectedHeader = 2;
+			}
+			else if (headerLength == 2 && (mosi & 0x80))
+			{
+				expectedHeader = 3;
+			}
+			if (headerLength == expectedHeader)
+			{
+				write = header[0] & 0x80;
+				address = header[0] & 0x3F;
+				offset = expectedHeader == 1 ? 0 : header[1] & 0x7F;
+				if (expectedHeader == 3)
+				{
+					offset |= (uint16_t)header[2] << 7;
+				}
+			}
+			return 0;
+		}
+		uint8_t &value = registers[address][offset++ % REGISTER_SIZE];
+		if (write)
+		{
+			value = mosi;
+			return 0;
+		}
+		return value;
+	}
+
+	bool _selected = false;
+	uint8_t header[3];
+	uint8_t headerLength = 0;
+	uint8_t expectedHeader = 1;
+	bool write = false;
+	uint8_t address = 0;
+	uint16_t offset = 0;
+};
+
+static RegisterModel model(5);
+
+static uint8_t headerLength(uint16_t offset)
+{
+	return offset == NO_SUB ? 1 : offset < 128 ? 2 : 3;
+}
+
+static uint32_t expectedBursts(uint16_t offset, uint16_t n)
+{
+	uint16_t first = DW1000Class::SPI_BURST_LEN - headerLength(offset);
+	return n <= first ? 1 : 1 + (n - first + DW1000Class::SPI_BURST_LEN - 1) / DW1000Class::SPI_BURST_LEN;
+}
+
+static void checkAccess(byte cmd, uint16_t offset, uint16_t n)
+{
+	static byte written[1024 + 8];
+	static byte read[1024 + 8];
+	uint16_t start = offset == NO_SUB ? 0 : offset;
+	for (uint16_t i = 0; i < n; i++)
+	{
+		written[i] = testRandom();
+	}
+	// guard bytes around the register part
+	byte before = start > 0 ? model.registers[cmd][start - 1] : 0;
+	byte after = model.registers[cmd][start + n];
+
+	uint32_t selects = model.selects;
+	DW1000Class::writeBytes(cmd, offset, written, n);
+	CHECK(model.selects == selects + 1, "write %02X:%u n=%u: %u chip selects", cmd, offset, n, model.selects - selects);
+	CHECK(model.bursts == expectedBursts(offset, n), "write %02X:%u n=%u: %u bursts, expected %u", cmd, offset, n,
+		  model.bursts, expectedBursts(offset, n));
+	CHECK(memcmp(model.registers[cmd] + start, written, n) == 0, "write %02X:%u n=%u: register content", cmd, offset, n);
+	CHECK(start == 0 || model.registers[cmd][start - 1] == before, "write %02X:%u n=%u: byte before", cmd, offset, n);
+	CHECK(model.registers[cmd][start + n] == after, "write %02X:%u n=%u: byte after", cmd, offset, n);
+
+	memset(read, 0xA5, sizeof(read));
+	selects = model.selects;
+	DW1000Class::readBytes(cmd, offset, read, n);
+	CHECK(model.selects == selects + 1, "read %02X:%u n=%u: %u chip selects", cmd, offset, n, model.selects - selects);
+	CHECK(model.bursts == expectedBursts(offset, n), "read %02X:%u n=%u: %u bursts, expected %u", cmd, offset, n,
+		  model.bursts, expectedBursts(offset, n));
+	CHECK(memcmp(read, written, n) == 0, "read %02X:%u n=%u: data", cmd, offset, n);
+	CHECK(read[n] == 0xA5, "read %02X:%u n=%u: wrote past the buffer", cmd, offset, n);
+}
+
+int main()
+{
+	DW1000Class::_ss = model.chipSelect;
+	spiDevice = &model;
+	for (uint32_t i = 0; i < sizeof(model.registers); i++)
+	{
+		((uint8_t *)model.registers)[i] = testRandom();
+	}
+
+	const uint16_t lengths[] = {1, 2, 4, 5, 8, 60, 61, 62, 63, 64, 65, 66, 124, 125, 126, 127, 128, 129, 1023, 1024};
+	const uint16_t offsets[] = {NO_SUB, 0x01, 0x05, 0x7F, 0x80, 0x81, 0x12C, 0x1000, 0x7000};
+	for (uint16_t offset : offsets)
+	{
+		for (uint16_t n : lengths)
+		{
+			checkAccess(TX_BUFFER, offset, n);
+			checkAccess(RX_BUFFER, offset, n);
+		}
+	}
+	// the helpers built on top
+	byte value[4] = {0x12, 0x34, 0x56, 0x78};
+	DW1000Class::writeByte(SYS_CFG, 2, 0x9A);
+	CHECK(model.registers[SYS_CFG][2] == 0x9A, "writeByte");
+	DW1000Class::writeBytes(PANADR, NO_SUB, value, 4);
+	CHECK(memcmp(model.registers[PANADR], value, 4) == 0, "PANADR");
+
+	CHECK(model.maxBurst <= DW1000Class::SPI_BURST_LEN, "burst of %u bytes", model.maxBurst);
+	CHECK(!model.misaligned, "buffer not word-aligned");
+	CHECK(!model.unselected, "transfer without chip select");
+	return TEST_RESULT();
+}
@@ -0,0 +1,141 @@
+/*
+ * DW1000Time integer arithmetic against a 128 bit reference:
+ * asymmetricTimeOfFlight() over the whole 40 bit range (wrapped durations,
+ * durations close to 2^40, both sides of the 2^31 fast path) and
+ * getAsMillimeters().
+ */
+
+#include "DW1000Time.h"
+#include "test.h"
+
+static int64_t referenceTimeOfFlight(int64_t round1, int64_t reply1, int64_t round2, int64_t reply2)
+{
+	__int128 r1 = round1 & DW1000Time::TIME_MAX, d1 = reply1 & DW1000Time::TIME_MAX;
+	__int128 r2 = round2 & DW1000Time::TIME_MAX, d2 = reply2 & DW1000Time::TIME_MAX;
+	__int128 sum = r1 + d1 + r2 + d2;
+	if (sum == 0)
+	{
+		return 0;
+	}
+	// truncated towards zero, like the library
+	return (int64_t)((r1 * r2 - d1 * d2) / sum);
+}
+
+static int32_t referenceMillimeters(int64_t timestamp)
+{
+	__int128 product = (__int128)(timestamp % DW1000Time::TIME_OVERFLOW) * 4691764;
+	return (int32_t)((product + (product < 0 ? -500000 : 500000)) / 1000000);
+}
+
+static void checkTimeOfFlight(int64_t round1, int64_t reply1, int64_t round2, int64_t reply2)
+{
+	int64_t expected = referenceTimeOfFlight(round1, reply1, round2, reply2);
+	int64_t actual = DW1000Time::asymmetricTimeOfFlight(round1, reply1, round2, reply2);
+	CHECK(actual == expected, "tof(%lld, %lld, %lld, %lld) = %lld, expected %lld", (long long)round1, (long long)reply1,
+		  (long long)round2, (long long)reply2, (long long)actual, (long long)expected);
+}
+
+// a duration of 0 to 40 bits, small values as likely as large ones
+static int64_t randomDuration()
+{
+	uint8_t bits = testRandom() % 41;
+	return bits == 0 ? 0 : (int64_t)(testRandom() & (((uint64_t)1 << bits) - 1));
+}
+
+static void testTimeOfFlight()
+{
+	const int64_t SMALL = (int64_t)1 << 31;
+	const int64_t MAX = DW1000Time::TIME_MAX;
+
+	checkTimeOfFlight(0, 0, 0, 0);
+
+	// a usual exchange: 3 m, replies of 2 and 2.5 ms
+	int64_t tof = 640;
+	int64_t reply1 = DW1000Duration::fromMicroseconds(2000).getTicks();
+	int64_t reply2 = DW1000Duration::fromMicroseconds(2500).getTicks();
+	checkTimeOfFlight(reply1 + 2 * tof, reply1, reply2 + 2 * tof, reply2);
+	CHECK(DW1000Time::asymmetricTimeOfFlight(reply2 + 2 * tof, reply1, reply1 + 2 * tof, reply2) == tof, "exact tof");
+
+	// both sides of the fast path
+	const int64_t boundary[] = {SMALL - 2, SMALL - 1, SMALL, SMALL + 1, 1, 0};
+	for (int64_t r1 : boundary)
+		for (int64_t d1 : boundary)
+			for (int64_t r2 : boundary)
+				for (int64_t d2 : boundary)
+					checkTimeOfFlight(r1, d1, r2, d2);
+
+	// close to 2^40, the products need 80 bits
+	const int64_t large[] = {MAX, MAX - 1, MAX / 2, MAX / 2 + 1, SMALL, 12345};
+	for (int64_t r1 : large)
+		for (int64_t d1 : large)
+			for (int64_t r2 : large)
+				for (int64_t d2 : large)
+					checkTimeOfFlight(r1, d1, r2, d2);
+
+	// durations from timestamps across the 40 bit wrap: the negative difference is the same exchange
+	int64_t pollSent = MAX - 1000;
+	int64_t pollAckReceived = pollSent + reply1 + 2 * tof - DW1000Time::TIME_OVERFLOW;
+	checkTimeOfFlight(pollAckReceived - pollSent, reply1, reply2 + 2 * tof, reply2);
+	CHECK(DW1000Time::asymmetricTimeOfFlight(pollAckReceived - pollSent, reply1, reply1 + 2 * tof, reply1) == tof,
+		  "wrapped round");
+	checkTimeOfFlight(-1, -1, -1, -1);
+	checkTimeOfFlight(-reply1, reply1, -SMALL, SMALL);
+
+	// negative results (replies longer than the rounds)
+	checkTimeOfFlight(reply1, reply1 + 100, reply2, reply2 + 100);
+	checkTimeOfFlight(SMALL, MAX, 1, MAX);
+
+	for (uint32_t i = 0; i < 1000000; i++)
+	{
+		checkTimeOfFlight(randomDuration(), randomDuration(), randomDuration(), randomDuration());
+	}
+	// every input of the fast path
+	for (uint32_t i = 0; i < 1000000; i++)
+	{
+		int64_t r1 = testRandom() % SMALL;
+		int64_t d1 = testRandom() % SMALL;
+		checkTimeOfFlight(r1, d1, testRandom() % SMALL, testRandom() % SMALL);
+	}
+}
+
+static void checkMillimeters(int64_t timestamp)
+{
+	int32_t expected = referenceMillimeters(timestamp);
+	int32_t actual = DW1000Time(timestamp).getAsMillimeters();
+	CHECK(actual == expected, "mm(%lld) = %d, expected %d", (long long)timestamp, actual, expected);
+}
+
+static void testMillimeters()
+{
+	// the result is an int32_t: up to ~2100 km
+	const int64_t RANGE = (int64_t)1 << 28;
+
+	const int64_t values[] = {0, 1, -1, 106, 107, -107, 213, 21314, RANGE, -RANGE};
+	for (int64_t value : values)
+	{
+		checkMillimeters(value);
+		// beyond the 40 bit counter the value wraps (keeping its sign)
+		int64_t wrapped = value + (value < 0 ? -DW1000Time::TIME_OVERFLOW : DW1000Time::TIME_OVERFLOW);
+		checkMillimeters(wrapped);
+		CHECK(DW1000Time(wrapped).getAsMillimeters() == DW1000Time(value).getAsMillimeters(), "wrap of %lld",
+			  (long long)value);
+	}
+	for (uint32_t i = 0; i < 1000000; i++)
+	{
+		checkMillimeters((int64_t)(testRandom() % (2 * RANGE)) - RANGE);
+	}
+
+	// against the speed of light within 1 mm up to 100 m
+	for (int64_t ticks = 0; ticks < 21314 * 1000; ticks += 997)
+	{
+		double exact = ticks * 4.6917639786159;
+		CHECK(fabs(DW1000Time(ticks).getAsMillimeters() - exact) <= 1.0, "mm(%lld) vs %.3f", (long long)ticks, exact);
+	}
+}
+
+int main()
+{
+	testTimeOfFlight();
+	testMillimeters();
+	return TEST_RESULT();
+}
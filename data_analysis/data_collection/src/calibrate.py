@@ -0,0 +1,158 @@
+"""
+Calibração automática dos delays de antena (método DecaWave, todos os pares).
+
+1. Coloca cada âncora em modo calibração ({"calibrar": true} no tópico de configuração):
+   ela reinicia como iniciador, mede contra todas as outras e volta a ser âncora.
+2. Coleta os ranges entre âncoras (e, se configurada, da tag de referência) via MQTT.
+3. Resolve por mínimos quadrados o erro de cada dispositivo: para o par (i, j)
+   medido - real = (x_i + x_j) * DISTANCE_OF_RADIO, x em ticks do DW1000.
+4. Novo delay = delay efetivo em uso (com a compensação de temperatura) + x;
+   com --apply grava em cada âncora ({"antenna_delay": N}, NVS).
+
+Uso: python src/calibrate.py [--apply] [--skip-ranging]
+"""
+
+import argparse
+import asyncio
+import json
+import math
+from collections import defaultdict
+
+import gmqtt
+import numpy as np
+import yaml
+
+# Metros por tick do DW1000 (DW1000Time::DISTANCE_OF_RADIO)
+DISTANCE_OF_RADIO = 0.0046917639786159
+
+
+class Calibration:
+    def __init__(self, config_path="config/config.yaml"):
+        with open(config_path, "r") as file:
+            self.config = yaml.safe_load(file)
+
+        cal = self.config["calibration"]
+        self.data_topic = cal["data_topic"]
+        self.config_topic = cal["config_topic"]
+        self.duration_s = cal["duration_s"]
+
+        # número da âncora -> (endereço, posição)
+        self.anchors = {int(n): (int(a["address"]), np.array(a["position"], dtype=float))
+                        for n, a in cal["anchors"].items()}
+        self.positions = {address: position for address, position in self.anchors.values()}
+        tag = cal.get("tag")
+        self.tag_address = int(tag["address"]) if tag else None
+        if tag:
+            self.positions[self.tag_address] = np.array(tag["position"], dtype=float)
+
+        # par (menor endereço, maior endereço) -> distâncias medidas
+        self.ranges = defaultdict(list)
+        # endereço -> delay de antena em uso
+        self.delays = {}
+        self.client = None
+
+    async def connect(self):
+        mqtt = self.config["mqtt"]
+        self.client = gmqtt.Client(mqtt["client_id"] + "-cal")
+        self.client.on_message = self.on_message
+        if mqtt.get("username") and mqtt.get("password"):
+            self.client.set_username_password(mqtt["username"], mqtt["password"])
+        await self.client.connect(mqtt["broker"], mqtt["port"], ssl=False)
+        self.client.subscribe(self.data_topic)
+        print(f"Coletando ranges em '{self.data_topic}'")
+
+    def on_message(self, client, topic, payload, qos, properties):
+        try:
+            data = json.loads(payload.decode())
+            anchor = int(data["id_ancora"])
+            tag = int(data["id_tag"])
+            # quem publica é o iniciador em modo calibração, senão a âncora
+            publisher = tag if data.get("cal") else anchor
+            if "ant_delay" in data:
+                self.delays[publisher] = int(data["ant_delay"])
+            if anchor in self.positions and tag in self.positions:
+                self.ranges[(min(anchor, tag), max(anchor, tag))].append(float(data["distancia"]))
+        except Exception as e:
+            print(f"Erro ao processar mensagem do tópico {topic}: {e}")
+
+    async def run_ranging(self):
+        # uma âncora por vez como iniciador, as outras respondem
+        for number in sorted(self.anchors):
+            topic = self.config_topic.format(n=number)
+            print(f"Âncora {number}: modo calibração ({self.duration_s} s)")
+            self.client.publish(topic, json.dumps({"calibrar": True}))
+            await asyncio.sleep(self.duration_s)
+
+    def solve(self):
+        nodes = sorted(self.positions)
+        index = {address: i for i, address in enumerate(nodes)}
+        rows, errors = [], []
+        for (a, b), measured in sorted(self.ranges.items()):
+            real = float(np.linalg.norm(self.positions[a] - self.positions[b]))
+            # mediana: robusta a multipercurso ocasional
+            error_ticks = (float(np.median(measured)) - real) / DISTANCE_OF_RADIO
+            row = np.zeros(len(nodes))
+            row[index[a]] = 1
+            row[index[b]] = 1
+            rows.append(row)
+            errors.append(error_ticks)
+            print(f"  {a:04X}-{b:04X}: {len(measured):4d} amostras, real {real:.3f} m, "
+                  f"erro {error_ticks * DISTANCE_OF_RADIO * 100:+.1f} cm")
+
+        if not rows:
+            raise RuntimeError("Nenhum par medido")
+        A = np.array(rows)
+        x, _, rank, _ = np.linalg.lstsq(A, np.array(errors), rcond=None)
+        if rank < len(nodes):
+            # ex.: só dois dispositivos, ou um dispositivo sem par medido
+            raise RuntimeError(f"Pares insuficientes: posto {rank} para {len(nodes)} dispositivos")
+        residual = A @ x - np.array(errors)
+        print(f"Resíduo RMS: {math.sqrt(np.mean(residual ** 2)) * DISTANCE_OF_RADIO * 100:.1f} cm")
+        return {address: x[index[address]] for address in nodes}
+
+    def new_delays(self, corrections):
+        result = {}
+        for number, (address, _) in sorted(self.anchors.items()):
+            if address not in self.delays:
+                print(f"Âncora {number} ({address:04X}): delay em uso desconhecido, ignorada")
+                continue
+            result[number] = round(self.delays[address] + corrections[address])
+            print(f"Âncora {number} ({address:04X}): {self.delays[address]} -> {result[number]}")
+        if self.tag_address is not None:
+            print(f"Tag {self.tag_address:04X}: correção {corrections[self.tag_address]:+.0f} ticks")
+        return result
+
+    def apply(self, delays):
+        for number, delay in delays.items():
+            self.client.publish(self.config_topic.format(n=number), json.dumps({"antenna_delay": delay}))
+        print("Delays gravados na NVS das âncoras")
+
+
+async def main():
+    parser = argparse.ArgumentParser(description="Calibração dos delays de antena")
+    parser.add_argument("--apply", action="store_true", help="grava os novos delays nas âncoras")
+    parser.add_argument("--skip-ranging", action="store_true",
+                        help="não comanda as âncoras, só coleta por duration_s (ex.: tag de referência)")
+    args = parser.parse_args()
+
+    calibration = Calibration()
+    await calibration.connect()
+    if args.skip_ranging:
+        await asyncio.sleep(calibration.duration_s)
+    else:
+        await calibration.run_ranging()
+        # a última âncora ainda reinicia e publica
+        await asyncio.sleep(5)
+
+    delays = calibration.new_delays(calibration.solve())
+    if args.apply:
+        calibration.apply(delays)
+        await asyncio.sleep(1)
+    await calibration.client.disconnect()
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass
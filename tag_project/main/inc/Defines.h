@@ -93,6 +93,12 @@ Arquivo de definições gerais do projeto de TAG UWB
 
 constexpr byte MODE[] = {DW1000_TX_RATE, DW1000_TX_FREQ, DW1000_TX_PREAMBLE};
 
+// ============================================================================
+// TDOA (BLINKS)
+// ============================================================================
+// Com TDOA_ENABLE a tag só transmite um BLINK por intervalo, sem TWR (as âncoras precisam do mesmo)
+#define TDOA_ENABLE false
+
 
 // ============================================================================
 // TIMEOUTS AND DELAYS
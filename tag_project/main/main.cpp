@@ -18,6 +18,11 @@ const int PWR_MGMT_1 = 0x6B;
 volatile int16_t ax, ay, az;
 int16_t offset_ax = 0, offset_ay = 0, offset_az = 0;
 
+// Instante da última amostra na base de tempo do DW1000 (us), a mesma dos ranges
+// 64 bits não são atômicos no ESP32: acesso protegido pelo spinlock
+int64_t accel_timestamp_us = 0;
+portMUX_TYPE accel_lock = portMUX_INITIALIZER_UNLOCKED;
+
 // Handles das Tasks
 TaskHandle_t handle_task_uwb;
 TaskHandle_t handle_task_mpu;
@@ -112,6 +117,10 @@ void setup() {
     DW1000Ranging.attachNewDevice(newDevice);
     DW1000Ranging.attachInactiveDevice(inactiveDevice);
 
+#if TDOA_ENABLE
+    DW1000Ranging.useTdoaBlinks(true);
+#endif
+
     Serial.printf("Tag ID: %X | MAC: %s\n", DW1000_TAG_SHORT_ADDRESS, DW1000_TAG_MAC_ADDRESS);
 
     // 3. Criação das Tasks Dual Core
@@ -151,11 +160,11 @@ void loop() {
 // --- CORE 1: PROTOCOLO UWB ---
 void task_uwb_routine(void * parameter) {
     Serial.println("[UWB] Task iniciada no Core 1");
+    // IRQ do DW1000 acorda esta task; sem IRQ dorme até o próximo prazo do Maestro
+    DW1000Ranging.useTaskNotification(xTaskGetCurrentTaskHandle());
     for (;;) {
         DW1000Ranging.loop();
-        // Pequeno yield para o Watchdog, mas rápido o suficiente para UWB
-        // taskYIELD(); // Use se precisar de velocidade máxima
-        vTaskDelay(pdMS_TO_TICKS(1)); 
+        DW1000Ranging.waitForEvent();
     }
 }
 
@@ -168,15 +177,21 @@ void task_mpu_routine(void * parameter) {
     for (;;) {
         // Leitura I2C (Bloqueante/Lenta) acontece aqui sem travar o UWB
         readAccelRaw(raw_ax, raw_ay, raw_az);
+        // Timestamp da amostra (sem SPI: derivado do esp_timer, seguro no Core 0)
+        int64_t sample_time = DW1000Timebase::now();
+        int64_t sample_timestamp_us = DW1000Timebase::toMicroseconds(sample_time);
         
         // Aplica Offset
         ax = raw_ax - offset_ax;
         ay = raw_ay - offset_ay;
         az = raw_az - offset_az;
         
-        // Passa o dado para a biblioteca DW1000
-        // (Assumindo que sua lib customizada tem esse método público)
-        DW1000Ranging.setAccelData(ax, ay, az);
+        // Passa o dado para a biblioteca DW1000, que envia a idade da amostra em cada POLL
+        DW1000Ranging.setAccelData(ax, ay, az, sample_time);
+
+        portENTER_CRITICAL(&accel_lock);
+        accel_timestamp_us = sample_timestamp_us;
+        portEXIT_CRITICAL(&accel_lock);
 
         // Taxa de atualização do sensor (50Hz = 20ms)
         vTaskDelay(pdMS_TO_TICKS(20));
@@ -192,7 +207,15 @@ void newRange(DW1000Device *device) {
     Serial.print("Ancora: ");
     Serial.print(device->getShortAddress(), HEX);
     Serial.print(" | Dist: ");
-    Serial.println(device->getRange());
+    Serial.print(device->getRange());
+
+    // Range e última amostra do MPU na mesma base de tempo (us), para alinhamento na fusão
+    portENTER_CRITICAL(&accel_lock);
+    int64_t last_accel_us = accel_timestamp_us;
+    portEXIT_CRITICAL(&accel_lock);
+    Serial.printf(" | t: %lld | t_acc: %lld\n",
+                  (long long)DW1000Timebase::toMicroseconds(device->getRangeTimestamp()),
+                  (long long)last_accel_us);
 }
 
 void newDevice(DW1000Device *device) {